@@ -0,0 +1,29 @@
+#include <iostream>
+#include <chrono>
+#include "mesh_classes.hpp"
+
+using namespace std;
+using namespace ProjectLibrary;
+
+
+int main(int argc, char *argv[])
+{
+    //converte Cell0Ds.csv, Cell1Ds.csv e Cell2Ds.csv di ogni test indicato nel formato binario Mesh.rmesh
+  vector<short int> test;
+  if(argc > 1)
+    for(int i=1;i<argc;i++)
+      test.push_back(stoi(argv[i]));
+  else
+    test = {1,2};
+
+  for(short int &t : test){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",t);
+    string path = "./../Project/Dataset/Test"+to_string(t)+"/Mesh.rmesh";
+    M.ExportBinary(path);
+    auto start = chrono::steady_clock::now();
+    TriangularMesh B("Mesh.rmesh",t);
+    auto stop = chrono::steady_clock::now();
+    cout<<t<<" "<<B.NumberTriangles()<<" triangles -> "<<path<<" (load "<<chrono::duration<double, milli>(stop-start).count()<<" ms)"<<endl;
+  }
+  return 0;
+}
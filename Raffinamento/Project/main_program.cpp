@@ -1,4 +1,5 @@
 #include <iostream>
+#include <chrono>
 #include "mesh_classes.hpp"
 
 using namespace std;
@@ -10,7 +11,7 @@ int main(int argc, char *argv[])
   vector<short int> test;
   test = {1,2};
   vector<double> theta;
-  vector<string> levels={"base", "advanced"};
+  vector<string> levels={"base", "advanced", "newest"};
   vector<string> uniformity={"non-uniform","uniform"};
 
   if(argc > 1)
@@ -19,19 +20,28 @@ int main(int argc, char *argv[])
   else
     theta = {0.2,0.4,0.6,0.8};
 
+  vector<TriangularMesh> base;  //ogni test viene importato una sola volta (dalla cache se i file non sono cambiati) e copiato per ogni configurazione
+  for(short int &t : test)
+    base.push_back(TriangularMesh("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",t,0,true));
+
+  ExportQueue queue;  //le esportazioni vengono scritte in background mentre si raffina la configurazione successiva
   for(double &percentage : theta){
-    for(short int &t : test){
+    for(unsigned int i=0; i<test.size(); i++){
+      short int &t = test[i];
       for(string &level : levels){
         for(string &unif : uniformity){
-          TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",t);
+          TriangularMesh M = base[i].Clone();
+          auto start = chrono::steady_clock::now();
           M.Refining(percentage,level,unif);
+          auto stop = chrono::steady_clock::now();
+          cout<<t<<" "<<percentage<<" "<<level<<" "<<unif<<" "<<M.NumberTriangles()<<" "<<chrono::duration<double, milli>(stop-start).count()<<" ms"<<endl;
     //      cout<<t<<" "<<percentage<<" "<<level<<" "<<unif<<" "<<M.nTriangles<<" "<<M.MediaArea()<<" "<<M.Varianza()<<endl;
-          M.ExportMesh({0});
     //      M.ExportParaviewfile();
-          M.ExportVTK();
+          queue.Push(move(M), {"cell0D","vtk"});
         }
       }
     }
   }
+  queue.Wait();
   return 0;
 }
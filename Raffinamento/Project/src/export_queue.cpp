@@ -0,0 +1,86 @@
+#include "mesh_classes.hpp"
+
+using namespace std;
+
+namespace ProjectLibrary
+{
+  ExportQueue::ExportQueue(size_t max_memory, unsigned int threads): max_memory(max_memory), threads(threads){
+    writer = thread(&ExportQueue::Run, this);
+  }
+  ExportQueue::~ExportQueue(){
+      //scrive quello che è ancora in coda prima di terminare; un errore non ancora riportato da Push o Wait
+      //non può essere rilanciato da un distruttore e viene scritto su cerr
+    {
+      unique_lock<mutex> lock(m);
+      changed.wait(lock, [this](){return jobs.empty() && !busy;});
+      stop = true;
+    }
+    changed.notify_all();
+    writer.join();
+    if(error){
+      try{rethrow_exception(error);}
+      catch(const exception &e){cerr<<"Error: a queued export failed and was not reported: "<<e.what()<<endl;}
+      catch(...){cerr<<"Error: a queued export failed and was not reported"<<endl;}
+    }
+  }
+  void ExportQueue::Push(TriangularMesh &&mesh, vector<string> formats){
+      //la mesh occupa MemoryUsage byte: tutti i vettori di cui è proprietaria (geometria, campi, marker, albero, journal, ...).
+      //una mesh più grande del limite viene accettata solo a coda vuota, altrimenti non entrerebbe mai
+    static const vector<string> known = {"cell0D", "cell1D", "cell2D", "binary", "archive", "vtk", "binary-vtk", "paraview", "matrix"};
+    for(const string &f : formats)
+      if(find(known.begin(), known.end(), f)==known.end()){cerr<<"Error: unknown export format "<<f<<endl; throw(1);}
+    size_t bytes = mesh.MemoryUsage();
+    unique_lock<mutex> lock(m);
+    changed.wait(lock, [&](){return error || queued==0 || queued+bytes<=max_memory;});
+    if(error){exception_ptr e = error; error = nullptr; rethrow_exception(e);}
+    queued += bytes;
+    jobs.push_back({move(mesh), move(formats), bytes});
+    lock.unlock();
+    changed.notify_all();
+  }
+  void ExportQueue::Wait(){
+      //aspetta che la coda sia vuota; rilancia l'eventuale errore di esportazione
+    unique_lock<mutex> lock(m);
+    changed.wait(lock, [this](){return jobs.empty() && !busy;});
+    if(error){exception_ptr e = error; error = nullptr; rethrow_exception(e);}
+  }
+  void ExportQueue::Run(){
+      //le mesh vengono scritte nell'ordine di arrivo; la memoria di una mesh si libera solo a scrittura finita
+    unique_lock<mutex> lock(m);
+    while(true){
+      changed.wait(lock, [this](){return stop || !jobs.empty();});
+      if(jobs.empty()) return;
+      busy = true;
+      Job job = move(jobs.front());
+      jobs.pop_front();
+      lock.unlock();
+      try{Write(job.mesh, job.formats);}
+      catch(...){
+        lock_guard<mutex> guard(m);
+        if(!error) error = current_exception();
+      }
+      job.mesh = TriangularMesh();
+      lock.lock();
+      queued -= job.bytes;
+      busy = false;
+      changed.notify_all();
+    }
+  }
+  void ExportQueue::Write(TriangularMesh &mesh, const vector<string> &formats){
+    vector<short int> cells;
+    for(const string &f : formats){
+      if(f=="cell0D") cells.push_back(0);
+      else if(f=="cell1D") cells.push_back(1);
+      else if(f=="cell2D") cells.push_back(2);
+      else if(f=="binary") cells.push_back(3);
+      else if(f=="archive") cells.push_back(4);
+    }
+    if(!cells.empty()) mesh.ExportMesh(cells, "", threads);
+    for(const string &f : formats){
+      if(f=="vtk") mesh.ExportVTK();
+      else if(f=="binary-vtk") mesh.ExportVTKBinary();
+      else if(f=="paraview") mesh.ExportParaviewfile(threads);
+      else if(f=="matrix") mesh.ExportMatrix(threads);
+    }
+  }
+}
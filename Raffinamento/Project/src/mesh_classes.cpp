@@ -1,9 +1,12 @@
 #include "mesh_classes.hpp"
 #include "sorting.hpp"
+#include "mesh_io.hpp"
 #include <iostream>
 #include "Eigen/Eigen"
 #include <fstream>
 #include <iomanip>
+#include <thread>
+#include <cstring>
 
 using namespace std;
 using namespace SortLibrary;
@@ -39,9 +42,14 @@ namespace ProjectLibrary
       arr[i]=pts[i];
     return arr;
   }
-  Triangle::Triangle(vector<Edge> edges, unsigned int id): id(id){
+  Triangle::Triangle(array<Edge,3> edges, unsigned int id, bool sorted): id(id){
       //costruisce il triangolo. controlla consistenza (in EdgesToPoints)
-    MSort<Edge>(edges);  // default : ordine decrescente
+      //se sorted=false mantiene l'ordine dei lati: edges[0] è il lato da dividere (newest vertex bisection)
+    if(sorted){
+      vector<Edge> sorted_edges(edges.begin(), edges.end());
+      MSort<Edge>(sorted_edges);  // default : ordine decrescente
+      copy(sorted_edges.begin(), sorted_edges.end(), edges.begin());
+    }
     this->edges = edges;
     points=EdgesToPoints();
 
@@ -81,179 +89,656 @@ namespace ProjectLibrary
     return edges[i];
   }
     //Import (Mesh)
-  TriangularMesh::TriangularMesh(const string cell0D, const string cell1D, const string cell2D, short int test): test(test){
-      //importa la mesh triangolare
-    if(!ImportCell0D(cell0D)){cerr<<"Error in import file"<<endl;}
-    if(!ImportCell1D(cell1D)){cerr<<"Error in import file"<<endl;}
-    if(!ImportCell2D(cell2D)){cerr<<"Error in import file"<<endl;}
+  TriangularMesh::TriangularMesh(const string cell0D, const string cell1D, const string cell2D, short int test, unsigned int threads, bool cache): test(test){
+      //importa la mesh triangolare: i tre file sono letti in parallelo, poi i riferimenti tra celle vengono risolti.
+      //con cache la mesh importata (adiacenze comprese) viene salvata in binario accanto ai file e riletta finché questi non cambiano
+    string path = "./../Project/Dataset/Test"+to_string(test)+"/";
+    string cache_path = path+"."+cell0D+"."+cell1D+"."+cell2D+".cache";
+    array<FileKey,3> keys;
+    if(cache && ReadCache(cache_path, {path+cell0D, path+cell1D, path+cell2D}, keys)) return;
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    array<Table,3> tables;
+    array<bool,3> read = {false, false, false};
+    array<exception_ptr,3> errors;  //righe non valide: rilanciate dopo aver aspettato gli altri file
+    auto Read = [&](unsigned int k, const string cell, const string format){
+      try{read[k] = ReadTable(path+cell, format, threads, tables[k]);}
+      catch(...){errors[k] = current_exception();}
+    };
+    thread reader1D([&](){Read(1, cell1D, "uuuu");});
+    thread reader2D([&](){Read(2, cell2D, "uuuuuuu");});
+    Read(0, cell0D, "uudd");
+    reader1D.join(); reader2D.join();
+    for(exception_ptr &e : errors)
+      if(e) rethrow_exception(e);
+    bool imported = true;  //ogni tabella viene liberata appena convertita: al più una convive con tutte le entità
+    if(!read[0] || !ImportCell0D(tables[0])){cerr<<"Error in import file"<<endl; imported = false;}
+    tables[0] = Table();
+    if(!read[1] || !ImportCell1D(tables[1], threads)){cerr<<"Error in import file"<<endl; imported = false;}
+    tables[1] = Table();
+    if(!read[2] || !ImportCell2D(tables[2], threads)){cerr<<"Error in import file"<<endl; imported = false;}
+    tables[2] = Table();
     this->AdjacenceMatrix();
+    if(cache && imported) WriteCache(cache_path, keys);
+  }
+  TriangularMesh::TriangularMesh(const string mesh, short int test, unsigned int step): test(test){
+      //importa la mesh dal formato binario (vedi MeshHeader), dall'archivio compresso (ExportArchive) o dalla serie
+      //di delta (ExportDelta, al passo step; UINT_MAX = l'ultimo), riconosciuti dall'intestazione
+    MappedFile file("./../Project/Dataset/Test"+to_string(test)+"/"+mesh);
+    if(file.Fail()){cerr<<"Error in import file"<<endl; throw(1);}
+    if(file.end()-file.begin()>=4 && memcmp(file.begin(), "RARC", 4)==0) ReadArchive(file.begin(), file.end());
+    else if(file.end()-file.begin()>=4 && memcmp(file.begin(), "RDLT", 4)==0) ReadDelta(file.begin(), file.end(), step);
+    else ReadBinary(file.begin(), file.end());
+  }
+  void TriangularMesh::ReadBinary(const char *begin, const char *end){
+      //il file è già mappato in memoria: ogni array viene copiato così com'è con un'unica copia di memoria,
+      //senza conversioni né ricalcolo di lunghezze e aree. le dimensioni sono controllate prima di allocare,
+      //poi ogni id e ogni riga di adiacenza, così un file danneggiato non porta mai fuori dagli array
+    MeshHeader header;
+    size_t size = end-begin;
+    if(size<sizeof(header)){cerr<<"Error: not a valid binary mesh"<<endl; throw(1);}
+    memcpy(&header, begin, sizeof(header));
+    MeshHeader expected;
+    if(header.magic!=expected.magic || header.version!=expected.version){cerr<<"Error: not a valid binary mesh"<<endl; throw(1);}
+    if(header.byte_order!=expected.byte_order || header.sizes[0]!=sizeof(Point) || header.sizes[1]!=sizeof(Edge) ||
+       header.sizes[2]!=sizeof(Triangle) || header.sizes[3]!=sizeof(AdjacentRow))
+      {cerr<<"Error: binary mesh written on a different platform"<<endl; throw(1);}
+    uint64_t counts[4] = {header.counts[0], header.counts[1], header.counts[2], header.counts[3]};
+    uint64_t needed = sizeof(header) + Align8(counts[0]*sizeof(Point)) + Align8(counts[1]*sizeof(Edge)) + Align8(counts[2]*sizeof(Triangle));
+    if(header.flags & MeshHeader::markers) needed += Align8(counts[0]*sizeof(unsigned int)) + Align8(counts[1]*sizeof(unsigned int));
+    if(header.flags & MeshHeader::adjacency) needed += Align8(counts[3]*sizeof(AdjacentRow));
+    if(needed>size){cerr<<"Error: truncated binary mesh"<<endl; throw(1);}
+    if((header.flags & MeshHeader::adjacency) && counts[3]!=counts[1]){cerr<<"Error: not a valid binary mesh"<<endl; throw(1);}
+    size_t offset = sizeof(header);
+    auto read = [&](void *data, size_t bytes){
+      if(bytes) memcpy(data, begin+offset, bytes);
+      offset = Align8(offset+bytes);
+    };
+    nPoints = header.counts[0]; nEdges = header.counts[1]; nTriangles = header.counts[2];
+    points.resize(nPoints); edges.resize(nEdges); triangles.resize(nTriangles);
+    read(points.data(), nPoints*sizeof(Point));
+    read(edges.data(), nEdges*sizeof(Edge));
+    read(triangles.data(), nTriangles*sizeof(Triangle));
+    point_marker.assign(nPoints, 0); edge_marker.assign(nEdges, 0);
+    if(header.flags & MeshHeader::markers){
+      read(point_marker.data(), nPoints*sizeof(unsigned int));
+      read(edge_marker.data(), nEdges*sizeof(unsigned int));
+    }
+    if(header.flags & MeshHeader::adjacency){
+      nRows = header.counts[3];
+      adjacent.resize(nRows);
+      read(adjacent.data(), nRows*sizeof(AdjacentRow));
+    }
+    bool valid = true;
+    for(unsigned int i=0; i<nPoints && valid; i++) valid = points[i].id==i;
+    for(unsigned int i=0; i<nEdges && valid; i++)
+      valid = edges[i].id==i && edges[i].p1.id<nPoints && edges[i].p2.id<nPoints;
+    for(unsigned int i=0; i<nTriangles && valid; i++){
+      const Triangle &T = triangles[i];
+      valid = T.id==i;
+      for(unsigned int j=0; j<3 && valid; j++)
+        valid = T.points[j].id<nPoints && T.edges[j].id<nEdges && T.edges[j].p1.id<nPoints && T.edges[j].p2.id<nPoints;
+    }
+    if(header.flags & MeshHeader::adjacency)
+      for(unsigned int i=0; i<nRows && valid; i++){
+        valid = adjacent[i].n<=2;
+        for(unsigned int j=0; j<adjacent[i].n && valid; j++) valid = adjacent[i][j]<nTriangles;
+      }
+    if(!valid){cerr<<"Error: not a valid binary mesh"<<endl; throw(1);}
+    if(!(header.flags & MeshHeader::adjacency)) AdjacenceMatrix();
+    MarkerEdges();
+  }
+  bool IdsInOrder(const Table &table, unsigned int columns){
+      //l'id di ogni riga (prima colonna intera) deve essere la sua posizione, come in ReadBinary
+    for(unsigned int i=0; i<table.rows; i++)
+      if(table.u[size_t(columns)*i]!=i) return false;
+    return true;
+  }
+  void TriangularMesh::ReadArchive(const char *begin, const char *end){
+      //decodifica l'archivio nelle stesse tabelle dell'importazione dei file di celle, poi lunghezze, aree e adiacenze
+      //vengono ricalcolate come nell'importazione
+    ArchiveReader in(begin+4, end);
+    uint64_t version = in.Varint(), flags = in.Varint();
+    if(in.Fail() || version!=1){cerr<<"Error: not a valid mesh archive"<<endl; throw(1);}
+    bool xor_encode = flags & 1;
+    Table table0D, table1D, table2D;
+    uint64_t n[3];  //controllati prima di convertirli: 2^32+5 non deve diventare 5
+    for(uint64_t &k : n) k = in.Varint();
+    if(in.Fail() || n[0]>UINT_MAX || n[1]>UINT_MAX || n[2]>UINT_MAX || n[0]+n[1]+n[2]>uint64_t(end-begin))
+      {cerr<<"Error: not a valid mesh archive"<<endl; throw(1);}
+    table0D.rows = n[0]; table1D.rows = n[1]; table2D.rows = n[2];
+    table0D.u.resize(2*table0D.rows); table0D.d.resize(2*table0D.rows);
+    uint64_t previous_x = 0, previous_y = 0;
+    for(unsigned int i=0; i<table0D.rows; i++){
+      table0D.u[2*i] = i+in.Signed();
+      table0D.u[2*i+1] = in.Varint();
+      table0D.d[2*i] = in.Double(previous_x, xor_encode);
+      table0D.d[2*i+1] = in.Double(previous_y, xor_encode);
+    }
+    table1D.u.resize(4*table1D.rows);
+    int64_t previous = 0;
+    for(unsigned int i=0; i<table1D.rows; i++){
+      unsigned int *row = &table1D.u[4*i];
+      row[0] = i+in.Signed();
+      row[1] = in.Varint();
+      row[2] = previous = previous+in.Signed();
+      row[3] = row[2]+in.Signed();
+    }
+    table2D.u.resize(7*table2D.rows);
+    int64_t previous_e = 0;
+    for(unsigned int i=0; i<table2D.rows; i++){
+      unsigned int *row = &table2D.u[7*i];   //i vertici (colonne 1-3) non servono: ImportCell2D li ricava dai lati
+      row[0] = i+in.Signed();
+      row[4] = previous_e = previous_e+in.Signed();
+      row[5] = row[4]+in.Signed(); row[6] = row[4]+in.Signed();
+    }
+    if(in.Fail()){cerr<<"Error: truncated mesh archive"<<endl; throw(1);}
+    if(!IdsInOrder(table0D, 2) || !IdsInOrder(table1D, 4) || !IdsInOrder(table2D, 7)){cerr<<"Error: not a valid mesh archive"<<endl; throw(1);}
+    unsigned int threads = max(1u, thread::hardware_concurrency());
+    if(!ImportCell0D(table0D) || !ImportCell1D(table1D, threads) || !ImportCell2D(table2D, threads, false))
+      {cerr<<"Error: not a valid mesh archive"<<endl; throw(1);}
+    AdjacenceMatrix();
+  }
+  void TriangularMesh::ReadDelta(const char *begin, const char *end, unsigned int step){
+      //riapplica i passi 0..step alle tabelle delle righe (il passo 0 contiene tutta la mesh), poi importa come i file di celle
+    ArchiveReader header(begin+4, end);
+    if(header.Varint()!=1 || header.Fail()){cerr<<"Error: not a valid delta file"<<endl; throw(1);}
+    const char *p = begin+5;
+    Table table0D, table1D, table2D;
+    unsigned int steps = 0;
+    while(p<end && steps<=step){
+      ArchiveReader length(p, end);
+      uint64_t size = length.Varint();
+      const char *q = length.Position();
+      if(length.Fail() || size>uint64_t(end-q)){cerr<<"Error: truncated delta file"<<endl; throw(1);}
+      ArchiveReader in(q, q+size);
+      p = q+size;
+      uint64_t n[3];
+      for(uint64_t &k : n) k = in.Varint();
+      if(in.Fail() || n[0]+n[1]+n[2]>uint64_t(end-begin)*8){cerr<<"Error: not a valid delta file"<<endl; throw(1);}
+      table0D.rows = n[0]; table0D.u.resize(2*n[0]); table0D.d.resize(2*n[0]);
+      table1D.rows = n[1]; table1D.u.resize(4*n[1]);
+      table2D.rows = n[2]; table2D.u.resize(7*n[2]);
+      uint64_t previous_x = 0, previous_y = 0;
+      int64_t previous = 0;
+      for(unsigned int k=0; k<3; k++){
+        uint64_t count = in.Varint();
+        int64_t pos = -1;
+        for(uint64_t r=0; r<count && !in.Fail(); r++){
+          pos += 1+in.Varint();
+          if(pos>=int64_t(n[k])){cerr<<"Error: not a valid delta file"<<endl; throw(1);}
+          unsigned int i = pos;
+          if(k==0){
+            table0D.u[2*i] = i+in.Signed();
+            table0D.u[2*i+1] = in.Varint();
+            table0D.d[2*i] = in.Double(previous_x, true);
+            table0D.d[2*i+1] = in.Double(previous_y, true);
+          }
+          else if(k==1){
+            unsigned int *row = &table1D.u[4*i];
+            row[0] = i+in.Signed();
+            row[1] = in.Varint();
+            row[2] = previous = previous+in.Signed();
+            row[3] = row[2]+in.Signed();
+          }
+          else{
+            unsigned int *row = &table2D.u[7*i];
+            row[0] = i+in.Signed();
+            row[4] = previous = previous+in.Signed();
+            row[5] = row[4]+in.Signed(); row[6] = row[4]+in.Signed();
+          }
+        }
+        previous = 0;
+      }
+      if(in.Fail()){cerr<<"Error: truncated delta file"<<endl; throw(1);}
+      steps++;
+    }
+    if(steps==0 || (step!=UINT_MAX && steps<=step)){cerr<<"Error: step "<<step<<" is not in the delta file"<<endl; throw(1);}
+    if(!IdsInOrder(table0D, 2) || !IdsInOrder(table1D, 4) || !IdsInOrder(table2D, 7)){cerr<<"Error: not a valid delta file"<<endl; throw(1);}
+    unsigned int threads = max(1u, thread::hardware_concurrency());
+    if(!ImportCell0D(table0D) || !ImportCell1D(table1D, threads) || !ImportCell2D(table2D, threads, false))
+      {cerr<<"Error: not a valid delta file"<<endl; throw(1);}
+    AdjacenceMatrix();
+  }
+  bool TriangularMesh::ReadCache(const string cache_path, const array<string,3> &paths, array<FileKey,3> &keys){
+      //la cache vale se ogni file ha la stessa dimensione e data di modifica registrate; se cambia solo la data
+      //si confronta l'hash del contenuto (e la cache viene aggiornata). keys restituisce le chiavi attuali dei file
+    MappedFile file(cache_path);
+    CacheHeader header;
+    bool valid = !file.Fail() && size_t(file.end()-file.begin())>=sizeof(header);
+    if(valid){
+      memcpy(&header, file.begin(), sizeof(header));
+      valid = header.magic==CacheHeader().magic && header.version==CacheHeader().version;
+    }
+    bool touched = false;
+    for(unsigned int i=0; i<3; i++){
+      keys[i] = FileKey();
+      if(!StatFile(paths[i], keys[i])) return false;
+      if(valid && keys[i].size==header.keys[i].size && keys[i].mtime!=header.keys[i].mtime){
+        keys[i].hash = HashFile(paths[i]);
+        touched = true;
+      }
+      else keys[i].hash = header.keys[i].hash;
+      valid = valid && keys[i].size==header.keys[i].size && keys[i].hash==header.keys[i].hash;
+    }
+    if(!valid){
+      for(unsigned int i=0; i<3; i++) keys[i].hash = HashFile(paths[i]);
+      return false;
+    }
+    try{ReadBinary(file.begin()+sizeof(header), file.end());}
+    catch(...){
+        //ReadBinary può essersi fermato a metà: l'importazione dai file riparte da una mesh vuota
+      short int t = test;
+      *this = TriangularMesh();
+      test = t;
+      for(unsigned int i=0; i<3; i++) keys[i].hash = HashFile(paths[i]);
+      return false;
+    }
+    if(touched) WriteCache(cache_path, keys);
+    return true;
   }
-  bool TriangularMesh::ImportCell0D(const string cell0D)
+  void TriangularMesh::WriteCache(const string cache_path, const array<FileKey,3> &keys){
+      //scrive la cache in un file temporaneo e lo rinomina, così un'altra esecuzione non legge mai una cache a metà.
+      //un errore di scrittura non è grave: la mesh è già stata importata
+    CacheHeader header;
+    for(unsigned int i=0; i<3; i++) header.keys[i] = keys[i];
+    string tmp = cache_path+".tmp";
+    ofstream file(tmp, ios::binary);
+    if(file.fail()) return;
+    file.write((const char*)&header, sizeof(header));
+    WriteBinary(file);
+    file.close();
+    if(file.fail() || rename(tmp.c_str(), cache_path.c_str())!=0) remove(tmp.c_str());
+  }
+  TriangularMesh TriangularMesh::Clone() const{
+      //copia della mesh importata (o raffinata) senza rileggere i file: punti, lati, triangoli e adiacenze
+      //sono vettori di elementi banalmente copiabili, quindi ogni vettore si copia con un'unica copia di memoria.
+      //la capacità in eccesso non viene copiata
+    return *this;
+  }
+  bool TriangularMesh::ImportCell0D(const Table &table)
   {
-    ifstream file;
-    file.open("./../Project/Dataset/Test"+to_string(test)+"/"+cell0D); if(file.fail()){return false;}
-
-    list<string> listLines;
-    string line;
-    while(getline(file, line)) {listLines.push_back(line);} file.close();
-
-    listLines.pop_front();
-    nPoints = listLines.size();
-    if(nPoints == 0){cerr << "There is no point" << endl; return false;}
-
-    points.reserve(nPoints);
-    for(const string& line : listLines){
-      istringstream converter(line);
-      unsigned int id, marker;
-      Vector2d coord;
-
-      converter >>  id >> marker >> coord(0) >> coord(1);
-      points.push_back(Point(coord(0),coord(1),id));
+      //righe "Id Marker X Y" nell'ordine del file
+    points.resize(table.rows); point_marker.resize(table.rows);
+    for(unsigned int i=0; i<table.rows; i++){
+      points[i] = Point(table.d[2*i], table.d[2*i+1], table.u[2*i]);
+      point_marker[i] = table.u[2*i+1];
     }
+    nPoints = points.size();
+    if(nPoints == 0){cerr << "There is no point" << endl; return false;}
     return true;
   }
-  bool TriangularMesh::ImportCell1D(const string cell1D)
+  bool TriangularMesh::ImportCell1D(const Table &table, unsigned int threads)
   {
-    ifstream file;
-    file.open("./../Project/Dataset/Test"+to_string(test)+"/"+cell1D); if(file.fail()){return false;}
-
-    list<string> listLines;
-    string line;
-    while(getline(file, line)) {listLines.push_back(line);} file.close();
-
-    listLines.pop_front();
-    nEdges = listLines.size();
+      //righe "Id Marker Origin End": i lati sono costruiti in parallelo, ogni riga scrive solo la propria posizione
+    for(unsigned int i=0; i<table.rows; i++)
+      if(table.u[4*i+2]>=nPoints || table.u[4*i+3]>=nPoints){cerr<<"Error: edge "<<table.u[4*i]<<" refers to a missing point"<<endl; return false;}
+    edges.resize(table.rows); edge_marker.resize(table.rows);
+    ParallelFor(table.rows, threads, [&](unsigned int begin, unsigned int end){
+      for(unsigned int i=begin; i<end; i++){
+        const unsigned int *row = &table.u[4*i];
+        edges[i] = Edge(points[row[2]], points[row[3]], row[0]);
+        edge_marker[i] = row[1];
+      }
+    });
+    nEdges = edges.size();
     if(nEdges == 0){cerr << "There is no edges" << endl; return false;}
-
-    edges.reserve(nEdges);
-    for(const string& line : listLines){
-      istringstream converter(line);
-      unsigned int id, marker;
-      array<unsigned int,2> vertices;
-
-      converter >> id >> marker >> vertices[0] >> vertices[1];
-      Point pt1_edge{FindPoint(vertices[0])};
-      Point pt2_edge{FindPoint(vertices[1])};
-      Edge E(pt1_edge,pt2_edge, id);
-      edges.push_back(E);
-    }
+    MarkerEdges();
     return true;
   }
-  bool TriangularMesh::ImportCell2D(const string cell2D)
+  bool TriangularMesh::ImportCell2D(const Table &table, unsigned int threads, bool sorted)
   {
-    ifstream file;
-    file.open("./../Project/Dataset/Test"+to_string(test)+"/"+cell2D); if(file.fail()){return false;}
-
-    list<string> listLines;
-    string line;
-    while(getline(file, line)) {listLines.push_back(line);} file.close();
-
-    listLines.pop_front();
-    nTriangles = listLines.size();
+      //righe "Id Vertices Edges": i vertici sono ricavati dai lati, come nell'importazione sequenziale.
+      //sorted=false mantiene l'ordine dei lati del file (archivi e delta, scritti dalla mesh in memoria)
+    for(unsigned int i=0; i<table.rows; i++)
+      for(unsigned int k = 4; k < 7; k++)
+        if(table.u[7*i+k]>=nEdges){cerr<<"Error: triangle "<<table.u[7*i]<<" refers to a missing edge"<<endl; return false;}
+    triangles.resize(table.rows);
+    ParallelFor(table.rows, threads, [&](unsigned int begin, unsigned int end){
+      for(unsigned int i=begin; i<end; i++){
+        const unsigned int *row = &table.u[7*i];
+        triangles[i] = Triangle({edges[row[4]], edges[row[5]], edges[row[6]]}, row[0], sorted);
+      }
+    });
+    nTriangles = triangles.size();
     if(nTriangles == 0){cerr << "There is no triangles" << endl; return false;}
-
-    triangles.reserve(nTriangles);
-    for(const string& line : listLines){
-      istringstream converter(line);
-      unsigned int id;
-      array<unsigned int, 3> vertices, edges;
-
-      converter >> id;
-      for(unsigned int i = 0; i < 3; i++) converter >> vertices[i];
-      for(unsigned int i = 0; i < 3; i++) converter >> edges[i];
-
-      Edge edg1; edg1=(FindEdge(edges[0]));
-      Edge edg2; edg2=(FindEdge(edges[1]));
-      Edge edg3; edg3=(FindEdge(edges[2]));
-      Triangle T({edg1,edg2,edg3}, id);
-      triangles.push_back(T);
-    }
     return true;
   }
   void TriangularMesh::AdjacenceMatrix(){
       //genera la matrice di adiacenza
       //riempie per triangoli
-    adjacent.resize(nEdges);   // iterare push_back è meno efficiente
+      //le righe vengono azzerate: una lettura non riuscita (cache danneggiata) può averle già riempite
+    adjacent.assign(nEdges, AdjacentRow());   // iterare push_back è meno efficiente
     for(Triangle &t : triangles)
       for(Edge &e : t.edges)
         adjacent[e.id].push_back(t.id);
     nRows = nEdges;
   }
     //Export (Mesh)
-  void TriangularMesh::ExportMesh(vector<short int> cells, string all){
+  void TriangularMesh::ExportMesh(vector<short int> cells, string all, unsigned int threads){
       //esporta la mesh raffinata.
-      //cells: 0 = cell0D , 1 = cell1D , 2 = cell2D
+      //cells: 0 = cell0D , 1 = cell1D , 2 = cell2D , 3 = mesh binaria , 4 = archivio compresso (3 e 4 non inclusi in "all")
+      //le righe sono formattate in parallelo a blocchi (threads = 0: tutti i core), il file è identico a quello sequenziale
     string level=this->level + ((this->level.empty())? "" : "/");
     if(all=="all") {cells.resize(3); cells={0,1,2};}
-    ofstream file;
-    int percentage = theta*100;
-    if(find(cells.begin(),cells.end(),0)!=cells.end()){
-      string cell0D = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"New0D"+uniformity+"_t"+to_string(percentage)+".csv";
-      file.open(cell0D);
-      if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
-      ExportCell0D(file); file.close();
-    }
-    if(find(cells.begin(),cells.end(),1)!=cells.end()){
-      string cell1D = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"New1D"+uniformity+"_t"+to_string(percentage)+".csv";
-      file.open(cell1D);
-      if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
-      ExportCell1D(file); file.close();
-    }
-    if(find(cells.begin(),cells.end(),2)!=cells.end()){
-      string cell2D = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"New2D"+uniformity+"_t"+to_string(percentage)+".csv";
-      file.open(cell2D);
-      if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
-      ExportCell2D(file); file.close();
-    }
-  }
-  void TriangularMesh::ExportCell0D(ostream& out){out<<"Id x y"<<endl;for(unsigned int i=0; i<nPoints; i++) {out<<points[i]<<endl;}}
-  void TriangularMesh::ExportCell1D(ostream& out){out<<"Id punto1 punto2"<<endl;for(unsigned int i=0; i<nEdges; i++) {out<<edges[i]<<endl;}}
-  void TriangularMesh::ExportCell2D(ostream& out){out<<"Id punto1 punto2 punto3 lato1 lato2 lato3"<<endl;for(unsigned int i=0; i<nTriangles; i++) {out<<triangles[i]<<endl;}}
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    string path = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level;
+    if(find(cells.begin(),cells.end(),0)!=cells.end())
+      if(!ParallelWrite(path+"New0D"+uniformity+"_"+ThetaTag()+".csv", "Id Marker x y\n", nPoints, threads,
+                        [this](TextWriter &out, unsigned int begin, unsigned int end){ExportCell0D(out, begin, end);}))
+        {cerr<<"Error in export file"<<endl; throw(1);}
+    if(find(cells.begin(),cells.end(),1)!=cells.end())
+      if(!ParallelWrite(path+"New1D"+uniformity+"_"+ThetaTag()+".csv", "Id Marker punto1 punto2\n", nEdges, threads,
+                        [this](TextWriter &out, unsigned int begin, unsigned int end){ExportCell1D(out, begin, end);}))
+        {cerr<<"Error in export file"<<endl; throw(1);}
+    if(find(cells.begin(),cells.end(),2)!=cells.end())
+      if(!ParallelWrite(path+"New2D"+uniformity+"_"+ThetaTag()+".csv", "Id punto1 punto2 punto3 lato1 lato2 lato3\n", nTriangles, threads,
+                        [this](TextWriter &out, unsigned int begin, unsigned int end){ExportCell2D(out, begin, end);}))
+        {cerr<<"Error in export file"<<endl; throw(1);}
+    if(find(cells.begin(),cells.end(),3)!=cells.end())
+      ExportBinary(path+"NewMesh"+uniformity+"_"+ThetaTag()+".rmesh");
+    if(find(cells.begin(),cells.end(),4)!=cells.end())
+      ExportArchive(path+"NewArchive"+uniformity+"_"+ThetaTag()+".rarc");
+  }
+  void TriangularMesh::ExportCell0D(TextWriter& out, unsigned int begin, unsigned int end){for(unsigned int i=begin; i<end; i++) {out<<points[i].id<<' '<<point_marker[i]<<' '<<points[i].x<<' '<<points[i].y<<'\n';}}
+  void TriangularMesh::ExportCell1D(TextWriter& out, unsigned int begin, unsigned int end){for(unsigned int i=begin; i<end; i++) {out<<edges[i].id<<' '<<edge_marker[i]<<' '<<edges[i].p1.id<<' '<<edges[i].p2.id<<'\n';}}
+  void TriangularMesh::ExportCell2D(TextWriter& out, unsigned int begin, unsigned int end){
+    for(unsigned int i=begin; i<end; i++){
+      const Triangle &T = triangles[i];
+      out<<T.id<<' '<<T.points[0].id<<' '<<T.points[1].id<<' '<<T.points[2].id<<' '<<T.edges[0].id<<' '<<T.edges[1].id<<' '<<T.edges[2].id<<'\n';
+    }
+  }
+  void TriangularMesh::ExportBinary(const string path){
+      //scrive la mesh nel formato binario (vedi MeshHeader), con marker e adiacenze
+    ofstream file(path, ios::binary);
+    if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
+    WriteBinary(file);
+    file.close();
+    if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
+  }
+  void TriangularMesh::ExportArchive(const string path, bool xor_coordinates){
+      //archivio compresso: gli id sono scritti come differenza dalla posizione, gli estremi dei lati e i lati dei triangoli come
+      //differenza da quelli della riga precedente e dal primo della riga (i figli nascono vicino ai padri), tutto in varint.
+      //le coordinate sono esatte, grezze o in XOR con la precedente (xor_coordinates)
+    ArchiveWriter out;
+    out.data.reserve(16*(size_t(nPoints)+nEdges+nTriangles)+64);
+    out.data.insert(out.data.end(), {'R','A','R','C'});
+    out.Varint(1);
+    out.Varint(xor_coordinates? 1 : 0);
+    out.Varint(nPoints); out.Varint(nEdges); out.Varint(nTriangles);
+    uint64_t previous_x = 0, previous_y = 0;
+    for(unsigned int i=0; i<nPoints; i++){
+      out.Signed(int64_t(points[i].id)-i);
+      out.Varint(point_marker[i]);
+      out.Double(points[i].x, previous_x, xor_coordinates);
+      out.Double(points[i].y, previous_y, xor_coordinates);
+    }
+    int64_t previous = 0;
+    for(unsigned int i=0; i<nEdges; i++){
+      const Edge &E = edges[i];
+      out.Signed(int64_t(E.id)-i);
+      out.Varint(edge_marker[i]);
+      out.Signed(int64_t(E.p1.id)-previous);
+      out.Signed(int64_t(E.p2.id)-E.p1.id);
+      previous = E.p1.id;
+    }
+    int64_t previous_e = 0;
+    for(unsigned int i=0; i<nTriangles; i++){
+      const Triangle &T = triangles[i];   //solo i lati: i vertici si ricavano dai lati, come nell'importazione
+      out.Signed(int64_t(T.id)-i);
+      out.Signed(int64_t(T.edges[0].id)-previous_e);
+      out.Signed(int64_t(T.edges[1].id)-T.edges[0].id); out.Signed(int64_t(T.edges[2].id)-T.edges[0].id);
+      previous_e = T.edges[0].id;
+    }
+    ofstream file(path, ios::binary);
+    if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
+    file.write(out.data.data(), out.data.size());
+    file.close();
+    if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
+  }
+  void TriangularMesh::RecordDelta(bool record){
+      //inizia (o interrompe) il tracciamento delle entità modificate: la prossima ExportDelta crea il file con la mesh intera
+    record_delta = record;
+    delta_all = true;
+    delta_steps = 0;
+    for(unsigned int k=0; k<3; k++){delta_flags[k].clear(); delta_ids[k].clear();}
+  }
+  void TriangularMesh::ExportDelta(const string path){
+      //aggiunge un passo al file: numero di punti, lati e triangoli e le sole righe nuove o sovrascritte dall'ultimo passo
+      //(posizioni crescenti in differenza, righe codificate come in ExportArchive). gli id riusati vengono riscritti
+    if(!record_delta) RecordDelta(true);
+    unsigned int n[3] = {nPoints, nEdges, nTriangles};
+    array<vector<unsigned int>,3> rows;
+    for(unsigned int k=0; k<3; k++){
+      if(delta_all){
+        rows[k].resize(n[k]);
+        for(unsigned int i=0; i<n[k]; i++) rows[k][i] = i;
+      }
+      else{
+        for(unsigned int id : delta_ids[k]) if(id<n[k]) rows[k].push_back(id);
+        sort(rows[k].begin(), rows[k].end());
+      }
+    }
+    ArchiveWriter out;
+    for(unsigned int k=0; k<3; k++) out.Varint(n[k]);
+    uint64_t previous_x = 0, previous_y = 0;
+    for(unsigned int k=0; k<3; k++){
+      out.Varint(rows[k].size());
+      int64_t pos = -1, previous = 0;
+      for(unsigned int i : rows[k]){
+        out.Varint(i-pos-1);
+        pos = i;
+        if(k==0){
+          out.Signed(int64_t(points[i].id)-i);
+          out.Varint(point_marker[i]);
+          out.Double(points[i].x, previous_x, true);
+          out.Double(points[i].y, previous_y, true);
+        }
+        else if(k==1){
+          const Edge &E = edges[i];
+          out.Signed(int64_t(E.id)-i);
+          out.Varint(edge_marker[i]);
+          out.Signed(int64_t(E.p1.id)-previous);
+          out.Signed(int64_t(E.p2.id)-E.p1.id);
+          previous = E.p1.id;
+        }
+        else{
+          const Triangle &T = triangles[i];
+          out.Signed(int64_t(T.id)-i);
+          out.Signed(int64_t(T.edges[0].id)-previous);
+          out.Signed(int64_t(T.edges[1].id)-T.edges[0].id); out.Signed(int64_t(T.edges[2].id)-T.edges[0].id);
+          previous = T.edges[0].id;
+        }
+      }
+    }
+    ArchiveWriter length;
+    if(delta_steps==0) length.data = {'R','D','L','T',1};
+    length.Varint(out.data.size());
+    ofstream file(path, ios::binary | ((delta_steps==0)? ios::trunc : ios::app));
+    if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
+    file.write(length.data.data(), length.data.size());
+    file.write(out.data.data(), out.data.size());
+    file.close();
+    if(file.fail()){cerr<<"Error in export file"<<endl; throw(1);}
+    delta_steps++;
+    delta_all = false;
+    for(unsigned int k=0; k<3; k++){
+      for(unsigned int id : delta_ids[k]) delta_flags[k][id] = 0;
+      delta_ids[k].clear();
+    }
+  }
+  unsigned int TriangularMesh::DeltaSteps(const string mesh, short int test){
+      //numero di passi nel file di delta
+    MappedFile file("./../Project/Dataset/Test"+to_string(test)+"/"+mesh);
+    if(file.Fail() || file.end()-file.begin()<5 || memcmp(file.begin(), "RDLT", 4)!=0){cerr<<"Error: not a valid delta file"<<endl; throw(1);}
+    unsigned int steps = 0;
+    for(const char *p = file.begin()+5; p<file.end(); steps++){
+      ArchiveReader length(p, file.end());
+      uint64_t size = length.Varint();
+      p = length.Position();
+      if(length.Fail() || size>uint64_t(file.end()-p)){cerr<<"Error: truncated delta file"<<endl; throw(1);}
+      p += size;
+    }
+    return steps;
+  }
+    //copia campo per campo in un elemento azzerato: i byte di allineamento delle strutture restano a 0
+  inline void CopyFields(Point &to, const Point &from){to.x = from.x; to.y = from.y; to.id = from.id;}
+  inline void CopyFields(Edge &to, const Edge &from){
+    CopyFields(to.p1, from.p1); CopyFields(to.p2, from.p2);
+    to.id = from.id; to.length = from.length;
+  }
+  inline void CopyFields(Triangle &to, const Triangle &from){
+    for(unsigned int i=0; i<3; i++){CopyFields(to.points[i], from.points[i]); CopyFields(to.edges[i], from.edges[i]);}
+    to.id = from.id; to.area = from.area;
+  }
+  inline void CopyFields(AdjacentRow &to, const AdjacentRow &from){
+    to.n = from.n;
+    for(unsigned int i=0; i<from.n; i++) to.t[i] = from.t[i];
+  }
+  inline void CopyFields(unsigned int &to, const unsigned int &from){to = from;}
+  template<class T> void WriteArray(ostream &file, const T *data, size_t n){
+      //scrive n elementi a blocchi, senza copiare i byte di allineamento (non inizializzati) della memoria
+    vector<T> block(min(n, size_t(4096)));
+    for(size_t i=0; i<n; i+=block.size()){
+      size_t m = min(block.size(), n-i);
+      memset((void*)block.data(), 0, m*sizeof(T));
+      for(size_t j=0; j<m; j++) CopyFields(block[j], data[i+j]);
+      file.write((const char*)block.data(), m*sizeof(T));
+    }
+    const char zeros[8] = {0};
+    file.write(zeros, Align8(n*sizeof(T))-n*sizeof(T));
+  }
+  void TriangularMesh::WriteBinary(ostream &file){
+      //gli array hanno la disposizione in memoria: il file si rilegge solo su macchine con lo stesso formato dei dati.
+      //i byte di allineamento sono scritti a 0, quindi la stessa mesh dà sempre lo stesso file
+    MeshHeader header;
+    header.flags = MeshHeader::markers | MeshHeader::adjacency;
+    header.sizes[0] = sizeof(Point); header.sizes[1] = sizeof(Edge); header.sizes[2] = sizeof(Triangle); header.sizes[3] = sizeof(AdjacentRow);
+    header.counts[0] = nPoints; header.counts[1] = nEdges; header.counts[2] = nTriangles; header.counts[3] = nRows;
+    file.write((const char*)&header, sizeof(header));
+    WriteArray(file, points.data(), nPoints);
+    WriteArray(file, edges.data(), nEdges);
+    WriteArray(file, triangles.data(), nTriangles);
+    WriteArray(file, point_marker.data(), nPoints);
+    WriteArray(file, edge_marker.data(), nEdges);
+    WriteArray(file, adjacent.data(), nRows);
+  }
     //Export Paraview file and VTK file
-  void TriangularMesh::ExportParaviewfile(){
-    ofstream file;
-    int percentage = theta*100;
+  void TriangularMesh::ExportParaviewfile(unsigned int threads){
     string level=this->level + ((this->level.empty())? "" : "/");
-    string cellParaview = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"NewParaview"+uniformity+"_t"+to_string(percentage)+".csv";
-    file.open(cellParaview);
-    if(file.fail()){cerr<<"Error in export file paraview"<<endl; throw(1);}
-    file<<"Id Id_p1 p1x p1y Id_p2 p2x p2y"<<endl;
-    for(Edge &edge : edges){file<<edge.id<<" "<<edge.p1<<" "<<edge.p2<<endl;}
-    file.close();
+    string cellParaview = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"NewParaview"+uniformity+"_"+ThetaTag()+".csv";
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    bool written = ParallelWrite(cellParaview, "Id Id_p1 p1x p1y Id_p2 p2x p2y\n", edges.size(), threads,
+                                 [this](TextWriter &file, unsigned int begin, unsigned int end){
+      for(unsigned int i=begin; i<end; i++){
+        const Edge &edge = edges[i];
+        file<<edge.id<<' '<<edge.p1.id<<' '<<edge.p1.x<<' '<<edge.p1.y<<' '<<edge.p2.id<<' '<<edge.p2.x<<' '<<edge.p2.y<<'\n';
+      }
+    });
+    if(!written){cerr<<"Error in export file paraview"<<endl; throw(1);}
   }
   void TriangularMesh::ExportVTK(){
     ofstream file;
-    int percentage = theta*100;
     string level=this->level + ((this->level.empty())? "" : "/");
-    string path = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"newVTK"+uniformity+"_t"+to_string(percentage)+".vtk";
+    string path = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"newVTK"+uniformity+"_"+ThetaTag()+".vtk";
     file.open(path);
     if(file.fail()){cerr<<"Error in export VTK file"<<endl; throw(1);}
-    file<<"# vtk DataFile Version 3.0"<<endl<<"vtk file_t"<<to_string(percentage)<<endl<<"ASCII"<<endl<<"DATASET POLYDATA"<<endl<<endl;
+    file<<"# vtk DataFile Version 3.0"<<endl<<"vtk file_"<<ThetaTag()<<endl<<"ASCII"<<endl<<"DATASET POLYDATA"<<endl<<endl;
     file<<"POINTS "<<nPoints<<" double"<<endl;
     for(Point &p : points)
       file<<setprecision(4)<<fixed<<p.x<<" "<<setprecision(4)<<fixed<<p.y<<" "<<setprecision(4)<<fixed<<0.0<<endl;
     file<<endl<<"LINES "<<nEdges<<" "<<nEdges*3<<endl;
     for(Edge &e : edges)
       file<<2<<" "<<e.p1.id<<" "<<e.p2.id<<endl;
+    //campi registrati: i triangoli vengono scritti solo se ci sono campi sui triangoli; le celle sono
+    //prima i lati (LINES) poi i triangoli (POLYGONS), i campi valgono 0 sulle celle dell'altro tipo
+    if(!fields[2].empty()){
+      file<<endl<<"POLYGONS "<<nTriangles<<" "<<nTriangles*4<<endl;
+      for(Triangle &t : triangles)
+        file<<3<<" "<<t.points[0].id<<" "<<t.points[1].id<<" "<<t.points[2].id<<endl;
+    }
+    file.unsetf(ios::floatfield);
+    file<<setprecision(10);
+    if(!fields[0].empty()) file<<endl<<"POINT_DATA "<<nPoints<<endl;
+    for(auto &f : fields[0]){
+      file<<"SCALARS "<<f.first<<" double 1"<<endl<<"LOOKUP_TABLE default"<<endl;
+      for(unsigned int i=0; i<nPoints; i++) file<<f.second.values[i]<<endl;
+    }
+    if(!fields[1].empty() || !fields[2].empty())
+      file<<endl<<"CELL_DATA "<<nEdges+((fields[2].empty())? 0 : nTriangles)<<endl;
+    for(unsigned int k=1; k<3; k++)
+      for(auto &f : fields[k]){
+        file<<"SCALARS "<<f.first<<" double 1"<<endl<<"LOOKUP_TABLE default"<<endl;
+        for(unsigned int i=0; i<nEdges; i++) file<<((k==1)? f.second.values[i] : 0.0)<<endl;
+        if(!fields[2].empty())
+          for(unsigned int i=0; i<nTriangles; i++) file<<((k==2)? f.second.values[i] : 0.0)<<endl;
+      }
     file.close();
   }
-  void TriangularMesh::ExportMatrix(){
-    ofstream file;
+  void TriangularMesh::ExportVTKBinary(bool cell_data){
+      //VTK legacy BINARY (big-endian, come richiesto dal formato): i triangoli sono le celle (POLYGONS), coordinate a precisione piena.
+      //cell_data: area, livello nell'albero delle bisezioni (se registrato) e campi sui triangoli. i campi sui punti vanno in POINT_DATA
     string level=this->level + ((this->level.empty())? "" : "/");
-    string matrix = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"matrix_"+uniformity+".csv";
-    file.open(matrix);
-    if(file.fail()){cerr<<"Error in export matrix"<<endl; throw(1);}
-    unsigned int edge_id=0;
-    for(vector<unsigned int> &v : adjacent){
-      unsigned int i=0;
-      file<<edge_id++<<" ";
-      for(unsigned int elt : v){
-        file<<((i)?" ":"")<<elt;
-        i++;
-      }
-      file<<endl;
+    string path = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"newBinaryVTK"+uniformity+"_"+ThetaTag()+".vtk";
+    ofstream file(path, ios::binary);
+    if(file.fail()){cerr<<"Error in export VTK file"<<endl; throw(1);}
+    file<<"# vtk DataFile Version 3.0\n"<<"vtk file_"<<ThetaTag()<<"\nBINARY\nDATASET POLYDATA\n";
+    file<<"POINTS "<<nPoints<<" double\n";
+    {
+      BigEndianWriter out(file);
+      for(unsigned int i=0; i<nPoints; i++){out.Put(points[i].x); out.Put(points[i].y); out.Put(0.0);}
     }
+    file<<"\nPOLYGONS "<<nTriangles<<" "<<nTriangles*4<<"\n";
+    {
+      BigEndianWriter out(file);
+      for(unsigned int i=0; i<nTriangles; i++){
+        out.Put(int32_t(3));
+        for(const Point &p : triangles[i].points) out.Put(int32_t(p.id));
+      }
+    }
+    if(!fields[0].empty()) file<<"\nPOINT_DATA "<<nPoints<<"\n";
+    for(auto &f : fields[0]){
+      file<<"SCALARS "<<f.first<<" double 1\nLOOKUP_TABLE default\n";
+      BigEndianWriter out(file);
+      for(unsigned int i=0; i<nPoints; i++) out.Put(f.second.values[i]);
+    }
+    if(cell_data){
+      file<<"\nCELL_DATA "<<nTriangles<<"\n"<<"SCALARS area double 1\nLOOKUP_TABLE default\n";
+      {
+        BigEndianWriter out(file);
+        for(unsigned int i=0; i<nTriangles; i++) out.Put(triangles[i].area);
+      }
+      if(tree.Size()>0){
+        file<<"\nSCALARS level int 1\nLOOKUP_TABLE default\n";
+        BigEndianWriter out(file);
+        for(unsigned int i=0; i<nTriangles; i++) out.Put(int32_t(tree.level[tree.leaf[i]]));
+      }
+      for(auto &f : fields[2]){
+        file<<"\nSCALARS "<<f.first<<" double 1\nLOOKUP_TABLE default\n";
+        BigEndianWriter out(file);
+        for(unsigned int i=0; i<nTriangles; i++) out.Put(f.second.values[i]);
+      }
+    }
+    file<<"\n";
     file.close();
+    if(file.fail()){cerr<<"Error in export VTK file"<<endl; throw(1);}
+  }
+  void TriangularMesh::ExportMatrix(unsigned int threads){
+    string level=this->level + ((this->level.empty())? "" : "/");
+    string matrix = "./../Project/Dataset/Test"+to_string(test)+"Completed/"+level+"matrix_"+uniformity+".csv";
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    bool written = ParallelWrite(matrix, "", adjacent.size(), threads, [this](TextWriter &file, unsigned int begin, unsigned int end){
+      for(unsigned int edge_id=begin; edge_id<end; edge_id++){
+        unsigned int i=0;
+        file<<edge_id<<' ';
+        for(unsigned int elt : adjacent[edge_id]){
+          if(i) file<<' ';
+          file<<elt;
+          i++;
+        }
+        file<<'\n';
+      }
+    });
+    if(!written){cerr<<"Error in export matrix"<<endl; throw(1);}
   }
     //Find and Modify (Mesh)
   Point TriangularMesh::FindPoint(unsigned int id_p){
@@ -282,6 +767,7 @@ namespace ProjectLibrary
       points[nPoints++]=point;
     }
     else points[indice]=point;
+    Dirty(0, indice);
   }
   void TriangularMesh::AddEdge(Edge edge, unsigned int indice){
       //aggiunge un lato in posizione data o in coda
@@ -292,6 +778,11 @@ namespace ProjectLibrary
       edges[nEdges++]=edge;
     }
     else edges[indice]=edge;
+    Dirty(1, indice);
+    if(!metric.empty()){
+      if(indice>=metric_length.size()) metric_length.resize(edges.size());
+      metric_length[indice] = MetricLength(edge);
+    }
   }
   void TriangularMesh::AddTriangle(Triangle triangle, unsigned int indice){
       //aggiunge un triangolo in posizione data o in coda
@@ -302,10 +793,13 @@ namespace ProjectLibrary
       triangles[nTriangles++]=triangle;
     }
     else triangles[indice]=triangle;
+    Dirty(2, indice);
   }
   void TriangularMesh::AdjustSize(){
     points.resize(nPoints);
+    point_marker.resize(nPoints);
     edges.resize(nEdges);
+    edge_marker.resize(nEdges);
     triangles.resize(nTriangles);
     adjacent.resize(nEdges);
   }
@@ -318,6 +812,20 @@ namespace ProjectLibrary
     Tnull.id=UINT_MAX;
     return Tnull;
   }
+  bool TriangularMesh::Conforming(){
+      //controlla che la mesh sia conforme: ogni lato di ogni triangolo è quello salvato in edges
+      //(nessun nodo sospeso) e la matrice di adiacenza è coerente con i triangoli
+    for(unsigned int i=0; i<nTriangles; i++){
+      if(triangles[i].id!=i) return false;
+      for(Edge &E : triangles[i].edges){
+        if(E.id>=nEdges || edges[E.id]!=E) return false;
+        if(find(adjacent[E.id].begin(),adjacent[E.id].end(),i)==adjacent[E.id].end()) return false;
+      }
+    }
+    for(unsigned int i=0; i<nEdges; i++)
+      if(adjacent[i].empty() || adjacent[i].size()>2) return false;
+    return true;
+  }
   void TriangularMesh::InsertRow(const vector<unsigned int> &t, unsigned int id_edge){
       //inserisce un nuovo lato, con le sue adiacenze, all'interno della matrice.
       //se il nuovo lato ha un id già utilizzato, sostituisce la riga corrispondente al lato rimpiazzato
@@ -325,11 +833,9 @@ namespace ProjectLibrary
         id_edge=nRows;
       if(id_edge>=adjacent.size())
         adjacent.resize(nRows*2);
-      adjacent[nRows].resize(t.size());
       adjacent[nRows++]=t;
     }
     else{
-      adjacent[id_edge].resize(t.size());
       adjacent[id_edge]=t;
     }
   }
@@ -345,12 +851,132 @@ namespace ProjectLibrary
   void TriangularMesh::AddCol(unsigned int id_tr, unsigned int id_edge){
       //aggiunge un'adiacenza a un lato
     adjacent[id_edge].push_back(id_tr);
+  }
+    //Refinement tree
+  void RefinementTree::Init(unsigned int nTriangles){
+      //una radice per ogni triangolo di partenza
+    triangle.resize(nTriangles); parent.assign(nTriangles, UINT_MAX); root.resize(nTriangles);
+    level.assign(nTriangles, 0); child.assign(nTriangles, UINT_MAX);
+    edge.assign(nTriangles, UINT_MAX); midpoint.assign(nTriangles, UINT_MAX);
+    leaf.resize(nTriangles);
+    for(unsigned int i=0; i<nTriangles; i++){triangle[i]=i; root[i]=i; leaf[i]=i;}
+    point_nodes.clear(); free_nodes.clear();
+    mergeable.clear(); mergeable_pos.clear();
+    level_start.clear(); level_nodes.clear();
+  }
+  void RefinementTree::Bisect(unsigned int id_t, unsigned int id_new, unsigned int id_edge, unsigned int id_point){
+      //registra la bisezione del triangolo id_t: il primo figlio mantiene id_t, il secondo ha id id_new
+    unsigned int p = leaf[id_t], c;
+    if(free_nodes.empty()){
+      c = triangle.size();
+      triangle.resize(c+2); parent.resize(c+2); root.resize(c+2); level.resize(c+2);
+      child.resize(c+2); edge.resize(c+2); midpoint.resize(c+2);
+    }
+    else{c = free_nodes.back(); free_nodes.pop_back();}
+    unsigned int ids[2] = {id_t, id_new};
+    for(unsigned int i=0; i<2; i++){
+      triangle[c+i] = ids[i]; parent[c+i] = p; root[c+i] = root[p]; level[c+i] = level[p]+1;
+      child[c+i] = UINT_MAX; edge[c+i] = UINT_MAX; midpoint[c+i] = UINT_MAX;
+    }
+    child[p] = c; edge[p] = id_edge; midpoint[p] = id_point;
+    if(id_new>=leaf.size()) leaf.resize(2*id_new+1);
+    leaf[id_t] = c; leaf[id_new] = c+1;
+    if(2*id_point+1>=point_nodes.size()) point_nodes.resize(4*id_point+2, UINT_MAX);
+    point_nodes[2*id_point + (point_nodes[2*id_point]!=UINT_MAX)] = p;
+    CheckMergeable(id_point);
+    if(parent[p]!=UINT_MAX) CheckMergeable(midpoint[parent[p]]);  //p non è più una foglia
+    level_start.clear();
+  }
+  void RefinementTree::Merge(unsigned int node, unsigned int id_t){
+      //annulla la bisezione del nodo: i due figli vengono liberati e il nodo torna foglia del triangolo id_t
+    unsigned int c = child[node], m = midpoint[node];
+    for(unsigned int i=0; i<2; i++){
+      triangle[c+i] = UINT_MAX; parent[c+i] = UINT_MAX; level[c+i] = UINT_MAX;
+    }
+    free_nodes.push_back(c);
+    if(m!=UINT_MAX){
+      point_nodes[2*m] = UINT_MAX;
+      point_nodes[2*m+1] = UINT_MAX;
+    }
+    child[node] = UINT_MAX; edge[node] = UINT_MAX; midpoint[node] = UINT_MAX;
+    triangle[node] = id_t;
+    leaf[id_t] = node;
+    if(m!=UINT_MAX) CheckMergeable(m);
+    if(parent[node]!=UINT_MAX) CheckMergeable(midpoint[parent[node]]);  //node è tornato foglia
+    level_start.clear();
+  }
+  size_t RefinementTree::MemoryUsage() const{
+    return Bytes(triangle)+Bytes(parent)+Bytes(root)+Bytes(level)+Bytes(child)+Bytes(edge)+Bytes(midpoint)+Bytes(leaf)+
+           Bytes(point_nodes)+Bytes(free_nodes)+Bytes(mergeable)+Bytes(mergeable_pos)+Bytes(level_start)+Bytes(level_nodes);
+  }
+  void RefinementTree::RenamePoint(unsigned int id_from, unsigned int id_to){
+      //il punto medio id_from prende l'id id_to (libero): nodi divisi in quel punto e candidati
+    for(unsigned int j=0; j<2; j++){
+      unsigned int node = point_nodes[2*id_from+j];
+      if(node!=UINT_MAX) midpoint[node] = id_to;
+    }
+    if(2*id_to+1>=point_nodes.size()) point_nodes.resize(2*id_to+2, UINT_MAX);
+    point_nodes[2*id_to] = point_nodes[2*id_from];
+    point_nodes[2*id_to+1] = point_nodes[2*id_from+1];
+    point_nodes[2*id_from] = point_nodes[2*id_from+1] = UINT_MAX;
+    if(id_from<mergeable_pos.size() && mergeable_pos[id_from]!=UINT_MAX){
+      if(id_to>=mergeable_pos.size()) mergeable_pos.resize(2*id_to+1, UINT_MAX);
+      mergeable[mergeable_pos[id_from]] = id_to;
+      mergeable_pos[id_to] = mergeable_pos[id_from];
+      mergeable_pos[id_from] = UINT_MAX;
+    }
+  }
+  bool RefinementTree::Mergeable(unsigned int id_point) const{
+      //tutte le bisezioni nel punto hanno entrambi i figli foglia
+    if(2*id_point+1>=point_nodes.size()) return false;
+    bool any = false;
+    for(unsigned int j=0; j<2; j++){
+      unsigned int node = point_nodes[2*id_point+j];
+      if(node==UINT_MAX) continue;
+      unsigned int c = child[node];
+      if(c==UINT_MAX || !IsLeaf(c) || !IsLeaf(c+1)) return false;
+      any = true;
+    }
+    return any;
+  }
+  void RefinementTree::CheckMergeable(unsigned int id_point){
+      //aggiunge o toglie il punto medio dai candidati (rimozione in O(1) spostando l'ultimo)
+    if(id_point>=mergeable_pos.size()) mergeable_pos.resize(2*id_point+1, UINT_MAX);
+    bool in = mergeable_pos[id_point]!=UINT_MAX, merge = Mergeable(id_point);
+    if(merge && !in){
+      mergeable_pos[id_point] = mergeable.size();
+      mergeable.push_back(id_point);
+    }
+    else if(!merge && in){
+      unsigned int last = mergeable.back(), pos = mergeable_pos[id_point];
+      mergeable[pos] = last;
+      mergeable_pos[last] = pos;
+      mergeable.pop_back();
+      mergeable_pos[id_point] = UINT_MAX;
+    }
+  }
+  void RefinementTree::BuildLevels(){
+      //ordina i nodi per livello (counting sort), per iterare un livello alla volta
+    unsigned int n_levels = 0;
+    for(unsigned int l : level) if(l!=UINT_MAX) n_levels = max(n_levels, l+1);
+    level_start.assign(n_levels+1, 0);
+    for(unsigned int l : level) if(l!=UINT_MAX) level_start[l+1]++;
+    for(unsigned int l=0; l<n_levels; l++) level_start[l+1] += level_start[l];
+    level_nodes.resize(level_start[n_levels]);
+    vector<unsigned int> pos(level_start.begin(), level_start.end()-1);
+    for(unsigned int node=0; node<level.size(); node++) if(Alive(node)) level_nodes[pos[level[node]]++] = node;
+  }
+  vector<unsigned int> RefinementTree::NodesAtLevel(unsigned int l){
+    if(l>=Levels()) return {};
+    return vector<unsigned int>(level_nodes.begin()+level_start[l], level_nodes.begin()+level_start[l+1]);
   }
     //Refining (Mesh)
   unsigned int TriangularMesh::TopTheta(){
       //salva i primi n_theta triangoli ordinati per area in n_theta e ne restituisce il numero
-    vector<Triangle> sorted_vec = triangles;
-    MSort<Triangle>(sorted_vec);
+    vector<MarkedTriangle> sorted_vec(nTriangles);
+    for(unsigned int i=0; i<nTriangles; i++)
+      sorted_vec[i] = MarkedTriangle(triangles[i], marks[triangles[i].id]);
+    MSort<MarkedTriangle>(sorted_vec);
     n_theta = round(theta*nTriangles);
     top_theta.resize(n_theta);
     top_theta = {sorted_vec.begin(), sorted_vec.begin()+n_theta};
@@ -374,55 +1000,761 @@ namespace ProjectLibrary
   bool TriangularMesh::Insert(Triangle &T){
     if(!top_theta.empty()){
 //      if(top_theta[n_theta-1]<=T){
-        SortInsert<Triangle>(top_theta,T,n_theta);
+        MarkedTriangle M(T, marks[T.id]);
+        SortInsert<MarkedTriangle>(top_theta,M,n_theta);
         return true;
 //      }
     }
     return false;
   }
-  void TriangularMesh::Refining(double theta, string level, string uniformity){
+  void TriangularMesh::Refining(double theta, string level, string uniformity, Indicator indicator){
     //chiama DivideTriangle finché non ha diviso tutti i triangoli del vettore top_theta
     if(theta>1 || theta<0) {cerr<<"Error: not valid percentage. Must be between 0 and 1"<<endl; throw(1);}
     this->theta = theta;
+    this->thetas = {theta};
     this->level = level;
     this->uniformity = uniformity;
+    this->indicator = indicator;
+    Refine();
+  }
+  void TriangularMesh::ResumeRefining(double theta, Indicator indicator){
+      //continua il raffinamento della mesh attuale con lo stesso livello e uniformità:
+      //theta è relativo ai triangoli attuali, la memoria già allocata viene riutilizzata (AdjustSize non riduce la capacità)
+    if(theta>1 || theta<0) {cerr<<"Error: not valid percentage. Must be between 0 and 1"<<endl; throw(1);}
+    if(level.empty()) {cerr<<"Error: nothing to resume, call Refining first"<<endl; throw(1);}
+    this->theta = theta;
+    thetas.push_back(theta);
+    this->indicator = indicator;
+    Refine();
+  }
+  void TriangularMesh::Refine(){
+      //le etichette vanno scelte prima di TopTheta, che copia i triangoli: RefineLoop divide le copie lungo edges[0]
+    if(level=="newest") LabelNewest();
+    MarkTriangles();
     TopTheta();
+    RefineLoop();
+  }
+  void TriangularMesh::RefineLoop(){
     // per ogni triangolo in top_theta:  dividi_triangolo (e ricalcola adiacenze)
-    while(n_theta > 0){
+    StartBudget();
+    while(n_theta > 0 && Budget(n_theta)){
       if(level=="base" || level=="advanced") DivideTriangle();
+      else if(level=="newest"){Triangle T(top_theta[0]); DivideTriangle_newest(T);}
       else {cerr<<"Error: invalid argument"<<endl; throw(1);}
     }
     AdjustSize();
+    marks.clear();
+  }
+    //Connected components
+  vector<unsigned int> TriangularMesh::Components(unsigned int &nComponents){
+      //componente connessa di ogni triangolo (union-find sui lati con due triangoli),
+      //numerate nell'ordine del primo triangolo di ciascuna
+    vector<unsigned int> parent(nTriangles);
+    for(unsigned int i=0; i<nTriangles; i++) parent[i] = i;
+    function<unsigned int(unsigned int)> Find = [&](unsigned int t){
+      while(parent[t]!=t){parent[t] = parent[parent[t]]; t = parent[t];}
+      return t;
+    };
+    for(unsigned int e=0; e<nEdges; e++)
+      if(adjacent[e].size()==2){
+        unsigned int r1 = Find(adjacent[e][0]), r2 = Find(adjacent[e][1]);
+        if(r1!=r2) parent[max(r1,r2)] = min(r1,r2);
+      }
+    vector<unsigned int> component(nTriangles), label(nTriangles, UINT_MAX);
+    nComponents = 0;
+    for(unsigned int i=0; i<nTriangles; i++){
+      unsigned int r = Find(i);
+      if(label[r]==UINT_MAX) label[r] = nComponents++;
+      component[i] = label[r];
+    }
+    return component;
+  }
+  void TriangularMesh::RefiningParallel(double theta, string level, string uniformity, unsigned int threads, Indicator indicator){
+      //come Refining, ma ogni componente connessa viene raffinata su un proprio thread come mesh separata
+      //(id locali, nessuna risorsa condivisa) e le parti vengono poi riunite rinumerando gli id per componente.
+      //la marcatura è globale. nel caso uniform i figli dovrebbero competere con i triangoli di tutte le componenti
+      //e la callback di avanzamento verrebbe chiamata da più thread: entrambi non sono ammessi.
+      //threads=0: tanti thread quanti i core
+    if(theta>1 || theta<0) {cerr<<"Error: not valid percentage. Must be between 0 and 1"<<endl; throw(1);}
+    if(level!="base" && level!="advanced" && level!="newest"){cerr<<"Error: invalid argument"<<endl; throw(1);}
+    if(uniformity=="uniform"){cerr<<"Error: parallel refinement is only non-uniform"<<endl; throw(1);}
+    if(options.progress){cerr<<"Error: parallel refinement cannot report progress"<<endl; throw(1);}
+    if(record_tree || record_journal){cerr<<"Error: parallel refinement cannot record the tree or the journal"<<endl; throw(1);}
+    unsigned int nComponents;
+    vector<unsigned int> component = Components(nComponents);
+    if(nComponents<=1){Refining(theta, level, uniformity, indicator); return;}
+    this->theta = theta;
+    this->thetas = {theta};
+    this->level = level;
+    this->uniformity = uniformity;
+    this->indicator = indicator;
+    if(level=="newest") LabelNewest();
+    MarkTriangles();
+    TopTheta();
+
+    vector<vector<unsigned int>> ids(nComponents);
+    for(unsigned int i=0; i<nTriangles; i++) ids[component[i]].push_back(i);
+    vector<TriangularMesh> parts(nComponents);
+    vector<unsigned int> local(nTriangles);
+    for(unsigned int c=0; c<nComponents; c++){
+      parts[c] = SubMesh(ids[c]);
+      for(unsigned int j=0; j<ids[c].size(); j++) local[ids[c][j]] = j;
+    }
+    for(MarkedTriangle &T : top_theta){  //la parte di top_theta di ogni componente, nello stesso ordine
+      TriangularMesh &S = parts[component[T.id]];
+      S.top_theta.push_back(MarkedTriangle(S.triangles[local[T.id]], T.mark));
+      S.n_theta++;
+    }
+    top_theta.clear();
+    n_theta = 0;
+
+      //un solo budget per tutta la mesh: le parti sommano i propri byte nello stesso contatore e misurano il tempo
+      //dallo stesso istante, così la mesh riunita non supera i limiti che Refining rispetterebbe
+    SharedBudget shared;
+    shared.start = chrono::steady_clock::now();
+    for(TriangularMesh &S : parts){
+      S.shared_budget = &shared;
+      S.shared_bytes = S.MemoryUsage();
+      shared.bytes += S.shared_bytes;
+    }
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    atomic<unsigned int> next(0);
+    auto work = [&](){
+      for(unsigned int c=next++; c<nComponents; c=next++)
+        if(parts[c].n_theta>0) parts[c].RefineLoop();
+    };
+    vector<thread> pool;
+    for(unsigned int t=1; t<min(threads, nComponents); t++) pool.emplace_back(work);
+    work();
+    for(thread &t : pool) t.join();
+
+    nPoints = nEdges = nTriangles = nRows = 0;
+    points.clear(); edges.clear(); triangles.clear(); adjacent.clear();
+    point_marker.clear(); edge_marker.clear(); metric.clear(); metric_length.clear();
+    for(auto &f : fields) for(auto &field : f) field.second.values.clear();
+    stopped = "";
+    for(TriangularMesh &S : parts){
+      AppendMesh(S);
+      if(stopped.empty()) stopped = S.stopped;
+    }
+    MarkerEdges();
+    grid.Clear();
+    bins.clear(); sample_x.clear(); sample_y.clear(); bin_bytes = 0;
+    marks.clear();
+  }
+  TriangularMesh TriangularMesh::SubMesh(const vector<unsigned int> &ids_t){
+      //copia dei triangoli ids_t (crescenti) con i loro lati e punti, numerati da 0 nell'ordine di comparsa
+    TriangularMesh S;
+    S.test = test; S.level = level; S.uniformity = uniformity; S.theta = theta;
+    S.indicator = indicator; S.newest_labels = newest_labels;
+    S.options = options;
+    S.metric_function = metric_function;
+    vector<unsigned int> map_p(nPoints, UINT_MAX), map_e(nEdges, UINT_MAX);
+    vector<unsigned int> ids_p, ids_e;
+    for(unsigned int t : ids_t)
+      for(Edge &E : triangles[t].edges){
+        if(map_e[E.id]==UINT_MAX){map_e[E.id] = ids_e.size(); ids_e.push_back(E.id);}
+        for(unsigned int p : {E.p1.id, E.p2.id})
+          if(map_p[p]==UINT_MAX){map_p[p] = ids_p.size(); ids_p.push_back(p);}
+      }
+    auto Remap = [&](Edge &E){E.id = map_e[E.id]; E.p1.id = map_p[E.p1.id]; E.p2.id = map_p[E.p2.id];};
+    for(unsigned int p : ids_p){
+      S.points.push_back(points[p]);
+      S.points.back().id = map_p[p];
+      S.point_marker.push_back(point_marker[p]);
+      if(!metric.empty()) S.metric.push_back(metric[p]);
+    }
+    for(unsigned int e : ids_e){
+      S.edges.push_back(edges[e]);
+      Remap(S.edges.back());
+      S.edge_marker.push_back(edge_marker[e]);
+      if(!metric.empty()) S.metric_length.push_back(metric_length[e]);
+    }
+    for(unsigned int j=0; j<ids_t.size(); j++){
+      Triangle T(triangles[ids_t[j]]);
+      T.id = j;
+      for(Point &p : T.points) p.id = map_p[p.id];
+      for(Edge &E : T.edges) Remap(E);
+      S.triangles.push_back(T);
+      if(!marks.empty()) S.marks.push_back(marks[ids_t[j]]);
+    }
+    const vector<unsigned int> *ids[3] = {&ids_p, &ids_e, &ids_t};
+    for(unsigned int k=0; k<3; k++)
+      for(auto &f : fields[k]){
+        MeshField &g = S.fields[k][f.first];
+        g.extensive = f.second.extensive;
+        for(unsigned int id : *ids[k]) g.values.push_back(f.second.values[id]);
+      }
+    S.nPoints = ids_p.size(); S.nEdges = ids_e.size(); S.nTriangles = ids_t.size();
+    S.AdjacenceMatrix();
+    S.MarkerEdges();
+    return S;
+  }
+  void TriangularMesh::AppendMesh(const TriangularMesh &S){
+      //aggiunge in coda una mesh disgiunta spostando i suoi id dopo quelli attuali
+    unsigned int oP = nPoints, oE = nEdges, oT = nTriangles;
+    DirtyAll();
+    auto Shift = [&](Edge &E){E.id += oE; E.p1.id += oP; E.p2.id += oP;};
+    for(unsigned int i=0; i<S.nPoints; i++){
+      points.push_back(S.points[i]);
+      points.back().id += oP;
+      point_marker.push_back(S.point_marker[i]);
+      if(!S.metric.empty()) metric.push_back(S.metric[i]);
+    }
+    for(unsigned int i=0; i<S.nEdges; i++){
+      edges.push_back(S.edges[i]);
+      Shift(edges.back());
+      edge_marker.push_back(S.edge_marker[i]);
+      if(!S.metric_length.empty()) metric_length.push_back(S.metric_length[i]);
+      AdjacentRow row = S.adjacent[i];
+      for(unsigned int &t : row) t += oT;
+      adjacent.push_back(row);
+    }
+    for(unsigned int i=0; i<S.nTriangles; i++){
+      Triangle T(S.triangles[i]);
+      T.id += oT;
+      for(Point &p : T.points) p.id += oP;
+      for(Edge &E : T.edges) Shift(E);
+      triangles.push_back(T);
+    }
+    unsigned int n[3] = {S.nPoints, S.nEdges, S.nTriangles};
+    for(unsigned int k=0; k<3; k++)
+      for(auto &f : S.fields[k]){
+        vector<double> &v = fields[k][f.first].values;
+        v.insert(v.end(), f.second.values.begin(), f.second.values.begin()+n[k]);
+      }
+    nPoints += S.nPoints; nEdges += S.nEdges; nTriangles += S.nTriangles; nRows = nEdges;
+  }
+  unsigned int TriangularMesh::RefiningRegion(const Region &region, double min_area, string level){
+      //divide i triangoli che intersecano la regione finché la loro area non è al più min_area.
+      //i candidati iniziali vengono dalla griglia, poi si controllano solo i figli delle bisezioni.
+      //restituisce il numero di triangoli divisi (senza contare quelli divisi per conformità)
+    if(min_area<=0){cerr<<"Error: minimum area must be positive"<<endl; throw(1);}
+    if(level!="base" && level!="advanced" && level!="newest"){cerr<<"Error: invalid argument"<<endl; throw(1);}
+    this->level = level;
+    uniformity = "region";
+    theta = 0;
+    thetas.clear();
+    if(level=="newest") LabelNewest();
+    if(!grid.Built()) grid.Build(triangles, nTriangles);
+
+    vector<unsigned int> queue;
+    for(unsigned int id : grid.Query(region.Bounds()))
+      if(region.Intersects(triangles[id].points)) queue.push_back(id);
+    unsigned int divided = 0;
+    record_bisected = true;
+    StartBudget();
+    for(unsigned int q=0; q<queue.size() && Budget(queue.size()-q); q++){
+      Triangle T(triangles[queue[q]]);  //gli id vengono riutilizzati: si ricontrolla il triangolo attuale
+      if(T.area<=min_area || !region.Intersects(T.points)) continue;
+      top_theta = {MarkedTriangle(T, T.area)};
+      n_theta = 1;
+      if(level=="newest") DivideTriangle_newest(T);
+      else DivideTriangle();
+      divided++;
+      queue.insert(queue.end(), bisected.begin(), bisected.end());
+      bisected.clear();
+    }
+    record_bisected = false;
+    top_theta.clear();
+    AdjustSize();
+    return divided;
+  }
+  unsigned int TriangularMesh::RefiningDensity(const string samples, unsigned int k, string level, double min_area){
+      //legge i campioni (x y per riga, le righe non numeriche come l'intestazione vengono saltate)
+    ifstream file(samples);
+    if(file.fail()){cerr<<"Error in import samples"<<endl; throw(1);}
+    vector<double> x, y;
+    string line;
+    while(getline(file, line)){
+      const char *begin = line.c_str();
+      char *end;
+      double px = strtod(begin, &end);
+      if(end==begin) continue;
+      begin = end;
+      double py = strtod(begin, &end);
+      if(end==begin) continue;
+      x.push_back(px);
+      y.push_back(py);
+    }
+    return RefiningDensity(x, y, k, level, min_area);
+  }
+  unsigned int TriangularMesh::RefiningDensity(const vector<double> &x, const vector<double> &y, unsigned int k, string level, double min_area){
+      //divide i triangoli che contengono più di k campioni (finché l'area è maggiore di min_area, per i campioni ripetuti).
+      //i campioni vengono assegnati ai triangoli una volta con la griglia, poi a ogni bisezione
+      //si ridistribuiscono solo quelli del triangolo diviso. restituisce il numero di triangoli divisi
+    if(x.size()!=y.size()){cerr<<"Error: inconsistent samples"<<endl; throw(1);}
+    if(level!="base" && level!="advanced" && level!="newest"){cerr<<"Error: invalid argument"<<endl; throw(1);}
+    this->level = level;
+    uniformity = "density";
+    theta = 0;
+    thetas.clear();
+    if(level=="newest") LabelNewest();
+    sample_x = x;
+    sample_y = y;
+    BinSamples();
+
+    vector<unsigned int> queue;
+    for(unsigned int i=0; i<nTriangles; i++)
+      if(bins[i].size()>k) queue.push_back(i);
+    unsigned int divided = 0;
+    record_bisected = true;
+    StartBudget();
+    for(unsigned int q=0; q<queue.size() && Budget(queue.size()-q); q++){
+      Triangle T(triangles[queue[q]]);
+      if(bins[T.id].size()<=k || T.area<=min_area) continue;
+      top_theta = {MarkedTriangle(T, T.area)};
+      n_theta = 1;
+      if(level=="newest") DivideTriangle_newest(T);
+      else DivideTriangle();
+      divided++;
+      for(unsigned int id : bisected)
+        if(bins[id].size()>k) queue.push_back(id);
+      bisected.clear();
+    }
+    record_bisected = false;
+    top_theta.clear();
+    AdjustSize();
+    return divided;
+  }
+  vector<unsigned int> TriangularMesh::Density(){
+      //numero di campioni per triangolo dell'ultimo raffinamento per densità (aggiornato dalle bisezioni successive)
+    vector<unsigned int> count(nTriangles, 0);
+    for(unsigned int i=0; i<nTriangles && i<bins.size(); i++) count[i] = bins[i].size();
+    return count;
+  }
+  void TriangularMesh::BinSamples(){
+      //assegna ogni campione al primo triangolo della sua cella che lo contiene; quelli fuori dalla mesh vengono scartati
+    if(!grid.Built()) grid.Build(triangles, nTriangles);
+    bins.assign(nTriangles, {});
+    for(unsigned int s=0; s<sample_x.size(); s++){
+      Point p(sample_x[s], sample_y[s], s);
+      for(unsigned int id : grid.At(p.x, p.y))
+        if(InTriangle(p, triangles[id].points)){bins[id].push_back(s); break;}
+    }
+    bin_bytes = 0;
+    for(const vector<unsigned int> &bin : bins) bin_bytes += Bytes(bin);
+  }
+  void TriangularMesh::SplitBin(const Triangle &newTriangle_a, const Triangle &newTriangle_b){
+      //ridistribuisce i campioni del padre (stesso id di newTriangle_a) tra i due figli.
+      //i tre semipiani del figlio a vengono scritti come a*x+b*y+c>=0 e valutati sui vettori delle coordinate
+    if(newTriangle_b.id>=bins.size()) bins.resize(2*newTriangle_b.id+1);
+    vector<unsigned int> parent;
+    parent.swap(bins[newTriangle_a.id]);
+    bin_bytes -= Bytes(parent);
+    if(parent.empty()) return;
+    array<double,3> a, b, c;
+    const array<Point,3> &p = newTriangle_a.points;
+    for(unsigned int i=0; i<3; i++){
+      const Point &p1 = p[i], &p2 = p[(i+1)%3];
+      a[i] = p1.y-p2.y;
+      b[i] = p2.x-p1.x;
+      c[i] = p1.x*p2.y-p2.x*p1.y;
+    }
+    vector<unsigned int> &bin_a = bins[newTriangle_a.id], &bin_b = bins[newTriangle_b.id];
+    bin_bytes -= Bytes(bin_b);
+    for(unsigned int s : parent){
+      double x = sample_x[s], y = sample_y[s];
+      bool in = (a[0]*x+b[0]*y+c[0]>=0) & (a[1]*x+b[1]*y+c[1]>=0) & (a[2]*x+b[2]*y+c[2]>=0);
+      (in? bin_a : bin_b).push_back(s);
+    }
+    bin_bytes += Bytes(bin_a)+Bytes(bin_b);
+  }
+  Indicator Indicator::Batch(function<void(const double*, const double*, double*, unsigned int)> f, unsigned int threads){
+    Indicator I;
+    I.batch = f;
+    I.threads = max(threads, 1u);
+    return I;
+  }
+  Indicator Indicator::Pointwise(function<double(double, double)> f, unsigned int threads){
+    return Batch([f](const double *x, const double *y, double *value, unsigned int n){
+      for(unsigned int i=0; i<n; i++) value[i] = f(x[i], y[i]);
+    }, threads);
+  }
+  Indicator Indicator::Values(vector<double> values){
+    Indicator I;
+    I.values = values;
+    return I;
+  }
+  void TriangularMesh::MarkTriangles(){
+      //calcola l'indicatore di tutti i triangoli prima della marcatura
+    marks.resize(nTriangles);
+    if(indicator.batch){
+      vector<unsigned int> ids(nTriangles);
+      for(unsigned int i=0; i<nTriangles; i++) ids[i] = i;
+      EvaluateIndicator(ids);
+    }
+    else if(!indicator.values.empty()){
+      if(indicator.values.size()<nTriangles){cerr<<"Error: indicator values must be one per triangle"<<endl; throw(1);}
+      copy(indicator.values.begin(), indicator.values.begin()+nTriangles, marks.begin());
+    }
+    else
+      for(unsigned int i=0; i<nTriangles; i++) marks[i] = triangles[i].area;
+  }
+  void TriangularMesh::EvaluateIndicator(const vector<unsigned int> &ids){
+      //valuta l'indicatore nei baricentri dei triangoli ids: coordinate in vettori separati,
+      //a blocchi di indicator.block elementi, divisi in parti contigue tra indicator.threads thread
+    unsigned int n = ids.size();
+    vector<double> x(n), y(n), value(n);
+    for(unsigned int i=0; i<n; i++){
+      const array<Point,3> &p = triangles[ids[i]].points;
+      x[i] = (p[0].x+p[1].x+p[2].x)/3;
+      y[i] = (p[0].y+p[1].y+p[2].y)/3;
+    }
+    unsigned int block = max(indicator.block, 1u);
+    auto work = [&](unsigned int begin, unsigned int end){
+      for(unsigned int i=begin; i<end; i+=block)
+        indicator.batch(&x[i], &y[i], &value[i], min(block, end-i));
+    };
+    unsigned int nthreads = min(indicator.threads, (n+block-1)/block);
+    if(nthreads<=1) work(0, n);
+    else{
+      unsigned int chunk = ((n+nthreads-1)/nthreads + block-1)/block*block;
+      vector<thread> pool;
+      for(unsigned int begin=0; begin<n; begin+=chunk)
+        pool.emplace_back(work, begin, min(n, begin+chunk));
+      for(thread &t : pool) t.join();
+    }
+    for(unsigned int i=0; i<n; i++) marks[ids[i]] = value[i];
+  }
+  void TriangularMesh::MarkChildren(const Triangle &T, const Triangle &newTriangle_a, const Triangle &newTriangle_b){
+      //valore dell'indicatore dei figli di T: valutato nei baricentri, oppure quello di T diviso in proporzione all'area
+    double mark = marks[T.id];
+    if(newTriangle_b.id>=marks.size()) marks.resize(2*newTriangle_b.id+1);
+    if(indicator.batch)
+      EvaluateIndicator({newTriangle_a.id, newTriangle_b.id});
+    else if(!indicator.values.empty()){
+      marks[newTriangle_a.id] = mark*newTriangle_a.area/T.area;
+      marks[newTriangle_b.id] = mark*newTriangle_b.area/T.area;
+    }
+    else{
+      marks[newTriangle_a.id] = newTriangle_a.area;
+      marks[newTriangle_b.id] = newTriangle_b.area;
+    }
+  }
+  void TriangularMesh::StartBudget(){
+    stopped = "";
+    splits = 0;
+    next_progress = options.progress_every;
+    start = (shared_budget)? shared_budget->start : chrono::steady_clock::now();
+  }
+  bool TriangularMesh::Budget(unsigned int remaining){
+      //controllato prima di ogni divisione: false se il raffinamento deve fermarsi
+    if(options.progress && splits>=next_progress){
+      options.progress(splits, remaining);
+      next_progress = splits + max(options.progress_every, 1u);
+    }
+    if(options.cancel && options.cancel->load()) stopped = "cancel";
+    else if(options.time_budget>0 && chrono::duration<double, milli>(chrono::steady_clock::now()-start).count()>options.time_budget) stopped = "time";
+    else if(options.memory_budget>0 && Usage()>options.memory_budget) stopped = "memory";
+    return stopped.empty();
+  }
+  size_t TriangularMesh::Usage(){
+      //memoria confrontata con il budget: quella della mesh, o di tutte le parti di RefiningParallel
+    if(!shared_budget) return MemoryUsage();
+    size_t bytes = MemoryUsage();
+    size_t total = shared_budget->bytes.fetch_add(bytes-shared_bytes)+bytes-shared_bytes;  //aritmetica modulare: anche se la parte si riduce
+    shared_bytes = bytes;
+    return total;
+  }
+  size_t TriangularMesh::MemoryUsage(){
+      //byte allocati da tutti i vettori della mesh: geometria, adiacenze, marcatura, campioni e griglia, metrica,
+      //marker, campi, albero delle bisezioni, journal e delta. le celle della griglia e i campioni per triangolo
+      //sono contati con i totali aggiornati a ogni modifica, così il controllo del budget resta O(1) per divisione
+    size_t bytes = Bytes(points)+Bytes(edges)+Bytes(triangles)+Bytes(adjacent)+Bytes(top_theta)+Bytes(marks)+Bytes(bisected)+
+                   Bytes(sample_x)+Bytes(sample_y)+Bytes(bins)+bin_bytes+grid.MemoryUsage()+Bytes(metric)+Bytes(metric_length)+
+                   Bytes(point_marker)+Bytes(edge_marker)+Bytes(marker_edges)+Bytes(marker_pos)+tree.MemoryUsage()+Bytes(journal)+Bytes(thetas);
+    for(const vector<unsigned int> &list : marker_edges) bytes += Bytes(list);
+    for(const auto &f : fields)
+      for(const auto &field : f) bytes += Bytes(field.second.values);
+    for(unsigned int k=0; k<3; k++) bytes += Bytes(delta_flags[k])+Bytes(delta_ids[k]);
+    return bytes;
+  }
+  string TriangularMesh::ThetaTag(){
+      //suffisso dei file esportati: t20 dopo un raffinamento, t20+40 dopo una ripresa
+    if(thetas.empty()) return "t"+to_string((int)(theta*100));
+    string tag = "t";
+    for(unsigned int i=0; i<thetas.size(); i++)
+      tag += ((i)? "+" : "") + to_string((int)(thetas[i]*100));
+    return tag;
+  }
+  uint8_t EdgeOrder(const Triangle &T, const Edge &add, const Edge &split){
+      //codifica la posizione dei lati di un figlio: 2 bit per lato (0 aggiunto, 1 metà, 2 esterno)
+    uint8_t order = 0;
+    for(unsigned int i=0; i<3; i++)
+      order |= ((T.edges[i].id==add.id)? 0 : (T.edges[i].id==split.id)? 1 : 2) << (2*i);
+    return order;
+  }
+  void TriangularMesh::BisectTriangle(Triangle &T, Point a, Point b, Edge &Split_a, Edge &Split_b, Triangle &newTriangle_a, Triangle &newTriangle_b, const JournalRecord *replay){
+      //divide T lungo il lato di estremi a e b: il figlio dalla parte di a mantiene l'id di T.
+      //se il lato non è ancora stato diviso (Split_a.id==UINT_MAX) crea il punto medio e le due metà,
+      //altrimenti riusa Split_a e Split_b (divisione del triangolo adiacente)
+    Edge E(T.PointsToEdge(a,b));
+    Point opposite(T.Opposite(E));
+    bool split = (Split_a.id==UINT_MAX);
+    Point medio = split? E.Medium(nPoints) : Split_a.p2;
+    if(split){
+      AddPoint(medio);
+      if(!metric.empty()){  //metrica nel punto medio: valutata o interpolata dagli estremi
+        if(medio.id>=metric.size()) metric.resize(points.size());
+        if(metric_function) metric[medio.id] = metric_function(medio.x, medio.y);
+        else for(unsigned int i=0; i<3; i++) metric[medio.id][i] = 0.5*(metric[a.id][i]+metric[b.id][i]);
+      }
+    }
+    Edge newEdgeAdd(opposite, medio, nEdges);
+    AddEdge(newEdgeAdd);
+    SetMarker(edge_marker, newEdgeAdd.id, 0);
+    if(split){
+      Split_a = Edge(a, medio, E.id);  //riutilizzo l'id del lato cancellato
+      AddEdge(Split_a, Split_a.id);
+      Split_b = Edge(b, medio, nEdges);
+      AddEdge(Split_b);
+      unsigned int marker = edge_marker[E.id];  //punto medio e metà ereditano il marker del lato
+      SetMarker(point_marker, medio.id, marker);
+      SetMarker(edge_marker, Split_b.id, marker);
+      if(marker){
+        if(Split_b.id>=marker_pos.size()) marker_pos.resize(edges.size());
+        marker_pos[Split_b.id] = marker_edges[marker].size();
+        marker_edges[marker].push_back(Split_b.id);
+      }
+    }
+    Edge outer_b(T.PointsToEdge(b, opposite));  //T.PointsToEdge è molto più ottimizzato rispetto a FindEdge
+    newTriangle_a = ChildTriangle(newEdgeAdd, Split_a, T.PointsToEdge(a, opposite), T.id, replay? replay->order_a : UINT8_MAX);  //riutilizzo l'id del triangolo cancellato
+    AddTriangle(newTriangle_a, newTriangle_a.id);
+    newTriangle_b = ChildTriangle(newEdgeAdd, Split_b, outer_b, nTriangles, replay? replay->order_b : UINT8_MAX);
+    AddTriangle(newTriangle_b);
+    if(!marks.empty()) MarkChildren(T, newTriangle_a, newTriangle_b);
+    SplitFields(T, E, a, b, medio, split, newEdgeAdd, Split_b, newTriangle_a, newTriangle_b);
+    if(grid.Built()){grid.Shrink(T, newTriangle_a); grid.Insert(newTriangle_b);}
+    if(!bins.empty()) SplitBin(newTriangle_a, newTriangle_b);
+    if(record_bisected){bisected.push_back(newTriangle_a.id); bisected.push_back(newTriangle_b.id);}
+    if(record_tree) tree.Bisect(T.id, newTriangle_b.id, E.id, medio.id);
+    if(record_journal && !replay)
+      journal.push_back({T.id, a.id, b.id, Split_a.id, Split_b.id, medio.id, newEdgeAdd.id, newTriangle_b.id,
+                         split, EdgeOrder(newTriangle_a, newEdgeAdd, Split_a), EdgeOrder(newTriangle_b, newEdgeAdd, Split_b), 0});
+
+    splits++;
+    InsertRow({newTriangle_a.id, newTriangle_b.id}, newEdgeAdd.id);
+    if(split){
+      InsertRow({newTriangle_a.id}, Split_a.id);
+      InsertRow({newTriangle_b.id}, Split_b.id);
+    }
+    else{
+      AddCol(newTriangle_a.id, Split_a.id);
+      AddCol(newTriangle_b.id, Split_b.id);
+    }
+    // il lato esterno può essere già stato rimpiazzato da una metà (raffinamento advanced)
+    if(find(adjacent[outer_b.id].begin(), adjacent[outer_b.id].end(), T.id)!=adjacent[outer_b.id].end())
+      ModifyRow(T.id, newTriangle_b.id, outer_b.id);
+  }
+  Triangle TriangularMesh::ChildTriangle(Edge add, Edge split, Edge outer, unsigned int id, uint8_t order){
+      //costruisce un figlio della bisezione. nel livello newest il lato di raffinamento del figlio
+      //è quello opposto al nuovo vertice (outer) e non serve ordinare i lati.
+      //con order (dal giornale) i lati vengono messi nell'ordine registrato, senza confronti
+    if(order!=UINT8_MAX){
+      Edge e[3] = {add, split, outer};
+      return Triangle({e[order & 3], e[(order>>2) & 3], e[(order>>4) & 3]}, id, false);
+    }
+    if(level=="newest")
+      return Triangle({outer, split, add}, id, false);
+    return Labelled({add, split, outer}, id);
+  }
+    //Fields
+  unsigned int TriangularMesh::Entity(string entity){
+    if(entity=="point") return 0;
+    if(entity=="edge") return 1;
+    if(entity=="triangle") return 2;
+    cerr<<"Error: invalid entity"<<endl; throw(1);
+  }
+  void TriangularMesh::AddField(string entity, string name, vector<double> values, bool extensive){
+      //registra un campo con un valore per ogni punto, lato o triangolo attuale (il nome diventa il nome VTK)
+    unsigned int k = Entity(entity);
+    unsigned int n = (k==0)? nPoints : (k==1)? nEdges : nTriangles;
+    if(values.size()!=n){cerr<<"Error: the field must have one value per "<<entity<<endl; throw(1);}
+    if(name.empty() || name.find_first_of(" \t\n")!=string::npos){cerr<<"Error: invalid field name"<<endl; throw(1);}
+    MeshField &f = fields[k][name];
+    f.values = values;
+    f.extensive = extensive;
+  }
+  vector<double>& TriangularMesh::GetField(string entity, string name){
+    unsigned int k = Entity(entity);
+    if(fields[k].find(name)==fields[k].end()){cerr<<"Error: field "<<name<<" not found"<<endl; throw(1);}
+    vector<double> &values = fields[k][name].values;
+    values.resize((k==0)? nPoints : (k==1)? nEdges : nTriangles);
+    return values;
+  }
+  void TriangularMesh::SplitFields(const Triangle &T, const Edge &E, const Point &a, const Point &b, const Point &medio, bool split,
+                                   const Edge &add, const Edge &split_b, const Triangle &newTriangle_a, const Triangle &newTriangle_b){
+      //trasferisce i campi nella bisezione: punto medio interpolato, metà del lato e figli copiati o divisi,
+      //lato aggiunto a 0 (estensivi) o alla media dei lati di T. la metà dalla parte di a e il figlio a hanno gli stessi id di E e T
+    if(split){
+      for(auto &f : fields[0]){
+        vector<double> &v = f.second.values;
+        if(medio.id>=v.size()) v.resize(points.size());
+        v[medio.id] = 0.5*(v[a.id]+v[b.id]);
+      }
+      for(auto &f : fields[1]){
+        vector<double> &v = f.second.values;
+        if(nEdges>v.size()) v.resize(edges.size());
+        if(f.second.extensive) v[E.id] *= 0.5;
+        v[split_b.id] = v[E.id];
+      }
+    }
+    for(auto &f : fields[1]){
+      vector<double> &v = f.second.values;
+      if(nEdges>v.size()) v.resize(edges.size());
+      v[add.id] = (f.second.extensive)? 0 : (v[T.edges[0].id]+v[T.edges[1].id]+v[T.edges[2].id])/3;
+    }
+    for(auto &f : fields[2]){
+      vector<double> &v = f.second.values;
+      if(nTriangles>v.size()) v.resize(triangles.size());
+      double value = v[T.id];
+      v[newTriangle_a.id] = (f.second.extensive)? value*newTriangle_a.area/T.area : value;
+      v[newTriangle_b.id] = (f.second.extensive)? value*newTriangle_b.area/T.area : value;
+    }
+  }
+  void TriangularMesh::MoveFields(unsigned int entity, unsigned int id_from, unsigned int id_to){
+    for(auto &f : fields[entity]) f.second.values[id_to] = f.second.values[id_from];
+  }
+  void TriangularMesh::SetMarker(vector<unsigned int> &markers, unsigned int id, unsigned int marker){
+    if(id>=markers.size()) markers.resize(2*id+1, 0);
+    markers[id] = marker;
+    Dirty((&markers==&point_marker)? 0 : 1, id);
+  }
+  void TriangularMesh::MarkerEdges(){
+      //raggruppa gli id dei lati di bordo per marker, così le ricerche sul bordo non scorrono tutti i lati
+    marker_edges.clear();
+    marker_pos.resize(nEdges);
+    for(unsigned int i=0; i<nEdges; i++)
+      if(edge_marker[i]){
+        if(edge_marker[i]>=marker_edges.size()) marker_edges.resize(edge_marker[i]+1);
+        marker_pos[i] = marker_edges[edge_marker[i]].size();
+        marker_edges[edge_marker[i]].push_back(i);
+      }
+  }
+  unsigned int TriangularMesh::RefiningBoundary(vector<unsigned int> markers, unsigned int layers, string level){
+      //divide una volta i triangoli a distanza di al più layers strati dai lati con i marker dati:
+      //il primo strato sono i triangoli con un lato marcato, ogni strato successivo quelli che hanno un lato
+      //in comune con lo strato precedente. restituisce il numero di triangoli divisi (senza quelli per conformità)
+    if(level!="base" && level!="advanced" && level!="newest"){cerr<<"Error: invalid argument"<<endl; throw(1);}
+    this->level = level;
+    uniformity = "boundary";
+    theta = 0;
+    thetas.clear();
+    if(level=="newest") LabelNewest();
+
+    vector<bool> selected(nTriangles, false);
+    vector<unsigned int> layer, queue;
+    for(unsigned int marker : markers)
+      for(unsigned int e : MarkedEdges(marker))
+        for(unsigned int t : adjacent[e])
+          if(!selected[t]){selected[t] = true; layer.push_back(t);}
+    for(unsigned int l=0; l<layers && !layer.empty(); l++){
+      queue.insert(queue.end(), layer.begin(), layer.end());
+      vector<unsigned int> next;
+      if(l+1<layers)
+        for(unsigned int t : layer)
+          for(Edge &E : triangles[t].edges)
+            for(unsigned int n : adjacent[E.id])
+              if(!selected[n]){selected[n] = true; next.push_back(n);}
+      layer.swap(next);
+    }
+
+    vector<bool> divided(nTriangles, false);  //triangoli (id) già divisi in questa passata, anche per conformità
+    unsigned int count = 0;
+    record_bisected = true;
+    StartBudget();
+    for(unsigned int q=0; q<queue.size() && Budget(queue.size()-q); q++){
+      unsigned int id = queue[q];
+      if(divided[id]) continue;
+      Triangle T(triangles[id]);
+      top_theta = {MarkedTriangle(T, T.area)};
+      n_theta = 1;
+      if(level=="newest") DivideTriangle_newest(T);
+      else DivideTriangle();
+      count++;
+      for(unsigned int b : bisected){
+        if(b>=divided.size()) divided.resize(2*b+1, false);
+        divided[b] = true;
+      }
+      bisected.clear();
+    }
+    record_bisected = false;
+    top_theta.clear();
+    AdjustSize();
+    return count;
+  }
+  Triangle TriangularMesh::Labelled(array<Edge,3> edges, unsigned int id){
+      //triangolo con il lato da dividere in edges[0]: il più lungo, nella metrica se è stata assegnata
+    if(metric.empty()) return Triangle(edges, id);
+    unsigned int k=0;
+    for(unsigned int j=1; j<3; j++)
+      if(MetricLonger(edges[j], edges[k])) k=j;
+    return Triangle({edges[k], edges[(k+1)%3], edges[(k+2)%3]}, id, false);
+  }
+    //Anisotropic metric
+  void TriangularMesh::SetMetric(vector<array<double,3>> metric){
+      //un tensore per punto (id). i lati vengono misurati con la media dei tensori agli estremi
+    if(metric.size()<nPoints){cerr<<"Error: the metric must be given for every point"<<endl; throw(1);}
+    for(array<double,3> &m : metric)
+      if(m[0]<=0 || m[0]*m[2]-m[1]*m[1]<=0){cerr<<"Error: metric not positive definite"<<endl; throw(1);}
+    metric_function = nullptr;
+    this->metric = metric;
+    ApplyMetric();
+  }
+  void TriangularMesh::SetMetric(function<array<double,3>(double, double)> f){
+      //tensore dato come funzione: valutato nei punti attuali e in ogni nuovo punto medio.
+      //i valori sono controllati prima di sostituire la metrica attuale, che un errore lascia invariata
+    vector<array<double,3>> values(nPoints);
+    for(unsigned int i=0; i<nPoints; i++){
+      values[i] = f(points[i].x, points[i].y);
+      if(values[i][0]<=0 || values[i][0]*values[i][2]-values[i][1]*values[i][1]<=0){cerr<<"Error: metric not positive definite"<<endl; throw(1);}
+    }
+    metric = move(values);
+    metric_function = f;
+    ApplyMetric();
+  }
+  void TriangularMesh::ClearMetric(){
+      //torna alla lunghezza euclidea: il lato da dividere di ogni triangolo viene scelto di nuovo senza metrica
+    if(metric.empty()) return;
+    metric.clear(); metric_length.clear(); metric_function = nullptr;
+    for(unsigned int i=0; i<nTriangles; i++)
+      triangles[i] = Labelled(triangles[i].edges, triangles[i].id);
+    newest_labels = false;
+    DirtyAll();
+  }
+  void TriangularMesh::ApplyMetric(){
+      //calcola le lunghezze dei lati nella metrica e sceglie di nuovo il lato da dividere di ogni triangolo
+    metric_length.resize(nEdges);
+    for(unsigned int i=0; i<nEdges; i++) metric_length[i] = MetricLength(edges[i]);
+    for(unsigned int i=0; i<nTriangles; i++)
+      triangles[i] = Labelled(triangles[i].edges, triangles[i].id);
+    newest_labels = false;
+    DirtyAll();
+  }
+  double TriangularMesh::MetricLength(const Edge &E){
+      //sqrt(v^T M v) con M media dei tensori agli estremi
+    const array<double,3> &m1 = metric[E.p1.id], &m2 = metric[E.p2.id];
+    double vx = E.p2.x-E.p1.x, vy = E.p2.y-E.p1.y;
+    return sqrt(0.5*((m1[0]+m2[0])*vx*vx + 2*(m1[1]+m2[1])*vx*vy + (m1[2]+m2[2])*vy*vy));
+  }
+  bool TriangularMesh::MetricLonger(const Edge &E1, const Edge &E2){
+      //ordine stretto: lunghezza nella metrica, a parità quello con id maggiore (la propagazione termina)
+    double l1 = metric_length[E1.id], l2 = metric_length[E2.id];
+    double tol = Point::geometricTol*max(l1, l2);
+    return l1 > l2+tol || (!(l2 > l1+tol) && E1.id>E2.id);
   }
   void TriangularMesh::DivideTriangle(){
       //divide il triangolo attuale (top_theta[0]) e quello adiacente al lato più lungo (se c'è)
-    Point medio;
-    Edge newEdgeAdd1,newEdgeSplit1, newEdgeSplit2;
+    Edge newEdgeSplit1, newEdgeSplit2;
     Triangle newTriangle1,newTriangle2, T(top_theta[0]);
+    newEdgeSplit1.id = UINT_MAX;
 
     // elimino il primo triangolo
     Extract(T);
 
-    medio = T.MaxEdge().Medium(nPoints);
-    AddPoint(medio);  //meglio aggiungerlo prima perché va inserito senza succ e prec
-    newEdgeAdd1 = Edge(T.points[2],medio,nEdges);
-    AddEdge(newEdgeAdd1);
-    newEdgeSplit1 = Edge(T.points[0],medio,T.MaxEdge().id);  //riutilizzo l'id del lato cancellato
-    AddEdge(newEdgeSplit1, newEdgeSplit1.id);
-    newEdgeSplit2 = Edge(T.points[1],medio,nEdges);
-    AddEdge(newEdgeSplit2);
-    newTriangle1 = Triangle({newEdgeAdd1,newEdgeSplit1,T.PointsToEdge(T.points[0],T.points[2])}, T.id);  //riutilizzo l'id del triangolo cancellato
-    AddTriangle(newTriangle1, newTriangle1.id);
-    newTriangle2 = Triangle({newEdgeAdd1,newEdgeSplit2,T.PointsToEdge(T.points[1],T.points[2])}, nTriangles);
-    AddTriangle(newTriangle2);
-
     Triangle AdjTriangle=FindAdjacence(T, T.MaxEdge());
-
-    InsertRow({newTriangle1.id, newTriangle2.id},newEdgeAdd1.id);
-    InsertRow({newTriangle1.id},newEdgeSplit1.id);
-    InsertRow({newTriangle2.id},newEdgeSplit2.id);
-    Edge tmp_e = T.PointsToEdge(T.points[1],T.points[2]);  //T.PointsToEdge è molto più ottimizzato rispetto a FindEdge
-    ModifyRow(T.id,newTriangle2.id,tmp_e.id);
+    BisectTriangle(T, T.points[0], T.points[1], newEdgeSplit1, newEdgeSplit2, newTriangle1, newTriangle2);
     //aggiorno top_theta con i nuovi triangoli, se necessario
     if(uniformity=="uniform"){
       Insert(newTriangle1);
@@ -431,28 +1763,14 @@ namespace ProjectLibrary
 
     if(AdjTriangle.id!=UINT_MAX){
       if(level=="advanced")
-        DivideTriangle_recursive(AdjTriangle, T.points[0], newEdgeSplit1, T.points[1], newEdgeSplit2, medio);
+        DivideTriangle_recursive(AdjTriangle, T.points[0], newEdgeSplit1, T.points[1], newEdgeSplit2);
       else{
-        Edge newEdgeAdd2;
         Triangle newTriangle3,newTriangle4;
 
         // elimino il secondo triangolo, se è nella lista
         Extract(AdjTriangle);
 
-        //trovo il vertice opposto al lato
-        Point opposite(AdjTriangle.Opposite(T.MaxEdge()));
-        newEdgeAdd2 = Edge(opposite, medio, nEdges);
-        AddEdge(newEdgeAdd2);
-        newTriangle3 = Triangle({newEdgeAdd2, newEdgeSplit1, AdjTriangle.PointsToEdge(opposite, T.points[0])}, AdjTriangle.id);  //riutilizzo l'id del triangolo cancellato
-        AddTriangle(newTriangle3, newTriangle3.id);
-        newTriangle4 = Triangle({newEdgeAdd2, newEdgeSplit2, AdjTriangle.PointsToEdge(opposite, T.points[1])}, nTriangles);
-        AddTriangle(newTriangle4);
-
-        InsertRow({newTriangle3.id, newTriangle4.id},newEdgeAdd2.id);
-        tmp_e = AdjTriangle.PointsToEdge(T.points[1],opposite);
-        ModifyRow(AdjTriangle.id,newTriangle4.id,tmp_e.id);
-        AddCol(newTriangle3.id,newEdgeSplit1.id);
-        AddCol(newTriangle4.id,newEdgeSplit2.id);
+        BisectTriangle(AdjTriangle, T.points[0], T.points[1], newEdgeSplit1, newEdgeSplit2, newTriangle3, newTriangle4);
         //aggiorno top_theta con i nuovi triangoli, se necessario
         if(uniformity=="uniform"){
           Insert(newTriangle3);
@@ -555,63 +1873,30 @@ namespace ProjectLibrary
     }
 
     if(AdjTriangle.id!=UINT_MAX)
-      DivideTriangle_recursive(AdjTriangle, T.points[0], newEdgeSplit1, T.points[1], newEdgeSplit2, medio);
+      DivideTriangle_recursive(AdjTriangle, T.points[0], newEdgeSplit1, T.points[1], newEdgeSplit2);
   }
-  void TriangularMesh::DivideTriangle_recursive(Triangle &T, Point p1, Edge &Split1, Point p2, Edge &Split2, Point &old_m){
+  void TriangularMesh::DivideTriangle_recursive(Triangle &T, Point p1, Edge &Split1, Point p2, Edge &Split2){
       //divide il triangolo attuale e ricorre su quello adiacente al lato più lungo (se c'è)
-    Edge newEdgeAdd1;
     Triangle newTriangle1,newTriangle2;
-    Point opposite(T.Opposite(T.MaxEdge()));
 
     Extract(T);
 
     if(T.MaxEdge()==T.PointsToEdge(p1, p2)){
-      newEdgeAdd1 = Edge(opposite, old_m, nEdges);
-      AddEdge(newEdgeAdd1);
-      newTriangle1 = Triangle({newEdgeAdd1, Split1, T.PointsToEdge(opposite, T.points[1])}, T.id);  //riutilizzo l'id del triangolo cancellato
-      AddTriangle(newTriangle1, newTriangle1.id);
-      newTriangle2 = Triangle({newEdgeAdd1, Split2, T.PointsToEdge(opposite, T.points[0])}, nTriangles);
-      AddTriangle(newTriangle2);
+      BisectTriangle(T, p1, p2, Split1, Split2, newTriangle1, newTriangle2);
 
       if(uniformity=="uniform"){
         Insert(newTriangle1);
         Insert(newTriangle2);
       }
-
-      InsertRow({newTriangle1.id, newTriangle2.id},newEdgeAdd1.id);
-      Edge tmp_e = T.PointsToEdge(T.points[0],opposite);
-      ModifyRow(T.id,newTriangle2.id,tmp_e.id);
-      AddCol(newTriangle1.id,Split1.id);
-      AddCol(newTriangle2.id,Split2.id);
-
       return;
     }
 
-    Point new_m;
     Edge newEdgeSplit1, newEdgeSplit2;
-    new_m = T.MaxEdge().Medium(nPoints);
-    AddPoint(new_m);
-
-    newEdgeAdd1 = Edge(opposite,new_m,nEdges);
-    AddEdge(newEdgeAdd1);
-    newEdgeSplit1 = Edge(T.points[0],new_m,T.MaxEdge().id);  //riutilizzo l'id del lato cancellato
-    AddEdge(newEdgeSplit1, newEdgeSplit1.id);
-    newEdgeSplit2 = Edge(T.points[1],new_m,nEdges);
-    AddEdge(newEdgeSplit2);
-    newTriangle1 = Triangle({newEdgeAdd1,newEdgeSplit1,T.PointsToEdge(T.points[0],opposite)}, T.id);  //riutilizzo l'id del triangolo cancellato
-    AddTriangle(newTriangle1, newTriangle1.id);
-    newTriangle2 = Triangle({newEdgeAdd1,newEdgeSplit2,T.PointsToEdge(T.points[1],opposite)},nTriangles);
-    AddTriangle(newTriangle2);
-
+    newEdgeSplit1.id = UINT_MAX;
     Triangle AdjTriangle=FindAdjacence(T, T.MaxEdge());
-
-    InsertRow({newTriangle1.id, newTriangle2.id},newEdgeAdd1.id);
-    InsertRow({newTriangle1.id},newEdgeSplit1.id);
-    InsertRow({newTriangle2.id},newEdgeSplit2.id);
-  // aggiusto adiacenze di newTriangle2 (newTriangle1 non ha id nuovo)
+    BisectTriangle(T, T.points[0], T.points[1], newEdgeSplit1, newEdgeSplit2, newTriangle1, newTriangle2);
+  // il figlio che contiene il lato (p1,p2) viene diviso di nuovo, l'altro è definitivo
     if(!newTriangle2.Includes(p1)){
-      Edge tmp_e = T.PointsToEdge(T.points[1],T.points[2]);  //T.PointsToEdge è molto più ottimizzato rispetto a FindEdge
-      ModifyRow(T.id,newTriangle2.id,tmp_e.id);
       if(uniformity=="uniform"){Insert(newTriangle2);}
     }
     else{
@@ -619,35 +1904,311 @@ namespace ProjectLibrary
     }
 
     if(AdjTriangle.id!=UINT_MAX)
-      DivideTriangle_recursive(AdjTriangle, T.points[0], newEdgeSplit1, T.points[1], newEdgeSplit2, new_m);
+      DivideTriangle_recursive(AdjTriangle, T.points[0], newEdgeSplit1, T.points[1], newEdgeSplit2);
 
-    Edge MtoM(new_m, old_m, nEdges);  // collego i punti in sospeso
-    AddEdge(MtoM);
+    // collego i punti in sospeso
     Triangle newTriangle3, newTriangle4;
-    if(T.points[1]==p2){
-      newTriangle3 = Triangle({MtoM, newEdgeAdd1, Split1}, newTriangle2.id);
-      newTriangle4 = Triangle({MtoM,newEdgeSplit2,Split2}, nTriangles);
-      ModifyRow(newTriangle2.id,newTriangle4.id,newEdgeSplit2.id);
-    }
-    else{
-      newTriangle3 = Triangle({MtoM, newEdgeSplit1, Split1}, newTriangle1.id);
-      newTriangle4 = Triangle({MtoM,newEdgeAdd1,Split2}, nTriangles);
-      ModifyRow(newTriangle1.id,newTriangle4.id,newEdgeAdd1.id);
-    }
-    AddTriangle(newTriangle3, newTriangle3.id);
-    AddTriangle(newTriangle4);
-    InsertRow({newTriangle3.id, newTriangle4.id},MtoM.id);
-//    ModifyRow(T.id,newTriangle4.id,newEdgeSplit2.id);
-//    ModifyRow(newTriangle1.id,newTriangle3.id,newEdgeAdd1.id);
-    AddCol(newTriangle3.id, Split1.id);
-    AddCol(newTriangle4.id, Split2.id);
+    BisectTriangle((T.points[1]==p2)? newTriangle2 : newTriangle1, p1, p2, Split1, Split2, newTriangle3, newTriangle4);
     if(uniformity=="uniform"){
       Insert(newTriangle3);
       Insert(newTriangle4);
     }
-
   }
-}
+    //Newest vertex bisection
+  void TriangularMesh::LabelNewest(){
+      //sceglie il lato di raffinamento iniziale di ogni triangolo (edges[0]): il lato più lungo,
+      //a parità di lunghezza quello con id maggiore. l'ordine stretto garantisce che la propagazione termini
+    if(newest_labels) return;
+    for(unsigned int i=0; i<nTriangles; i++){
+      Triangle &T = triangles[i];
+      unsigned int k=0;
+      for(unsigned int j=1; j<3; j++)
+        if((metric.empty())? (T.edges[j]>T.edges[k] || (!(T.edges[k]>T.edges[j]) && T.edges[j].id>T.edges[k].id)) : MetricLonger(T.edges[j], T.edges[k]))
+          k=j;
+      T = Triangle({T.edges[k], T.edges[(k+1)%3], T.edges[(k+2)%3]}, T.id, false);
+    }
+    newest_labels=true;
+    DirtyAll();
+  }
+  void TriangularMesh::DivideTriangle_newest(Triangle &T){
+      //divide T lungo il suo lato di raffinamento, insieme al triangolo adiacente.
+      //se l'adiacente ha un lato di raffinamento diverso viene prima diviso lui (propagazione limitata)
+    Edge newEdgeSplit1, newEdgeSplit2;
+    Triangle newTriangle1,newTriangle2;
+    newEdgeSplit1.id = UINT_MAX;
+
+    Triangle AdjTriangle=FindAdjacence(T, T.MaxEdge());
+    if(AdjTriangle.id!=UINT_MAX && AdjTriangle.MaxEdge().id!=T.MaxEdge().id){
+      DivideTriangle_newest(AdjTriangle);
+      AdjTriangle=FindAdjacence(T, T.MaxEdge());  //il figlio che contiene il lato ha lo stesso lato di raffinamento
+    }
 
+    Extract(T);
+    BisectTriangle(T, T.points[0], T.points[1], newEdgeSplit1, newEdgeSplit2, newTriangle1, newTriangle2);
+    if(uniformity=="uniform"){
+      Insert(newTriangle1);
+      Insert(newTriangle2);
+    }
 
+    if(AdjTriangle.id!=UINT_MAX){
+      Triangle newTriangle3,newTriangle4;
+      Extract(AdjTriangle);
+      BisectTriangle(AdjTriangle, T.points[0], T.points[1], newEdgeSplit1, newEdgeSplit2, newTriangle3, newTriangle4);
+      if(uniformity=="uniform"){
+        Insert(newTriangle3);
+        Insert(newTriangle4);
+      }
+    }
+  }
+    //Coarsening (Mesh)
+  unsigned int TriangularMesh::Coarsening(function<bool(const Triangle&)> criterion){
+      //annulla le bisezioni i cui figli sono foglie e soddisfano criterion, un livello per chiamata.
+      //un punto medio viene tolto solo insieme a tutte le bisezioni che lo usano (1 o 2), così la mesh resta conforme.
+      //i candidati sono quelli tenuti aggiornati dall'albero; griglia, campioni e lati di bordo vengono aggiornati
+      //solo per i triangoli uniti o spostati. restituisce il numero di punti medi tolti
+    if(!record_tree){cerr<<"Error: coarsening needs the refinement tree (RecordTree)"<<endl; throw(1);}
+    if(record_journal){cerr<<"Error: the refinement journal cannot record coarsening"<<endl; throw(1);}
+    vector<unsigned int> candidates;
+    for(unsigned int m : tree.mergeable){
+      bool merge = true;
+      for(unsigned int j=0; j<2 && merge; j++){
+        unsigned int p = tree.point_nodes[2*m+j];
+        if(p==UINT_MAX) continue;
+        unsigned int c = tree.child[p];
+        merge = criterion(triangles[tree.triangle[c]]) && criterion(triangles[tree.triangle[c+1]]);
+      }
+      if(merge) candidates.push_back(m);
+    }
+    // dal punto medio più recente: i buchi lasciati vengono riempiti con l'ultimo elemento
+    sort(candidates.begin(), candidates.end(), greater<unsigned int>());
+    for(unsigned int m : candidates)
+      MergeSiblings(m);
+    AdjustSize();
+    return candidates.size();
+  }
+  void TriangularMesh::MergeSiblings(unsigned int id_point){
+      //riunisce le coppie di fratelli create dalle bisezioni nel punto id_point e compatta gli id
+    Point medio(points[id_point]);
+    vector<unsigned int> holes_t, holes_e;
+    Edge Split_b;
+    unsigned int nodes[2] = {tree.point_nodes[2*id_point], tree.point_nodes[2*id_point+1]};
+    for(unsigned int p : nodes){
+      if(p==UINT_MAX) continue;
+      Triangle A(triangles[tree.triangle[tree.child[p]]]), B(triangles[tree.triangle[tree.child[p]+1]]);
+      Edge add, split_a, outer_a, outer_b;
+      for(Edge &e : A.edges){
+        if(B.Includes(e)) add = e;
+        else if(e.Includes(medio)) split_a = e;
+        else outer_a = e;
+      }
+      for(Edge &e : B.edges)
+        if(!A.Includes(e)){
+          if(e.Includes(medio)) Split_b = e;
+          else outer_b = e;
+        }
+      Point a = (split_a.p1==medio)? split_a.p2 : split_a.p1;
+      Point b = (Split_b.p1==medio)? Split_b.p2 : Split_b.p1;
+      Edge E(a, b, split_a.id);  //il lato intero riprende l'id della metà dalla parte di a
+      if(holes_t.empty())  //il lato intero è lo stesso per le due coppie di fratelli
+        for(auto &f : fields[1])
+          if(f.second.extensive) f.second.values[E.id] += f.second.values[Split_b.id];
+      for(auto &f : fields[2]){
+        vector<double> &v = f.second.values;
+        v[A.id] = (f.second.extensive)? v[A.id]+v[B.id] : (v[A.id]*A.area+v[B.id]*B.area)/(A.area+B.area);
+      }
+      AddEdge(E, E.id);
+      Triangle T = (level=="newest")? Triangle({E, outer_a, outer_b}, A.id, false) : Labelled({E, outer_a, outer_b}, A.id);
+      AddTriangle(T, T.id);
+      if(grid.Built()){grid.Remove(B); grid.Grow(T);}
+      if(!bins.empty()){
+        bin_bytes -= Bytes(bins[A.id]);
+        bins[A.id].insert(bins[A.id].end(), bins[B.id].begin(), bins[B.id].end());
+        bin_bytes += Bytes(bins[A.id]);
+        bins[B.id].clear();
+      }
+      ModifyRow(B.id, A.id, outer_b.id);
+      tree.Merge(p, A.id);
+      holes_t.push_back(B.id);
+      holes_e.push_back(add.id);
+    }
+    holes_e.push_back(Split_b.id);
+    unsigned int marker = edge_marker[Split_b.id];  //la metà tolta esce dalla lista del suo marker
+    if(marker){
+      vector<unsigned int> &list = marker_edges[marker];
+      unsigned int pos = marker_pos[Split_b.id];
+      list[pos] = list.back();
+      marker_pos[list[pos]] = pos;
+      list.pop_back();
+    }
+    sort(holes_t.begin(), holes_t.end(), greater<unsigned int>());
+    sort(holes_e.begin(), holes_e.end(), greater<unsigned int>());
+    for(unsigned int id : holes_t) MoveTriangle(--nTriangles, id);
+    for(unsigned int id : holes_e){MoveEdge(--nEdges, id); nRows--;}
+    MovePoint(--nPoints, id_point);
+  }
+  void TriangularMesh::MoveTriangle(unsigned int id_from, unsigned int id_to){
+      //sposta il triangolo id_from nella posizione id_to (lasciata libera)
+    if(id_from==id_to) return;
+    if(grid.Built()) grid.Rename(triangles[id_from], id_to);
+    if(!bins.empty()) bins[id_to].swap(bins[id_from]);
+    Triangle &T = triangles[id_to];
+    T = triangles[id_from];
+    T.id = id_to;
+    Dirty(2, id_to);
+    MoveFields(2, id_from, id_to);
+    for(Edge &e : T.edges)
+      ModifyRow(id_from, id_to, e.id);
+    if(record_tree){
+      unsigned int node = tree.leaf[id_from];
+      tree.triangle[node] = id_to;
+      tree.leaf[id_to] = node;
+    }
+  }
+  void TriangularMesh::MoveEdge(unsigned int id_from, unsigned int id_to){
+      //sposta il lato id_from nella posizione id_to (lasciata libera) e aggiorna le copie nei triangoli adiacenti
+    if(id_from==id_to) return;
+    edges[id_to] = edges[id_from];
+    edges[id_to].id = id_to;
+    Dirty(1, id_to);
+    if(!metric.empty()) metric_length[id_to] = metric_length[id_from];
+    edge_marker[id_to] = edge_marker[id_from];
+    if(edge_marker[id_to]){
+      marker_pos[id_to] = marker_pos[id_from];
+      marker_edges[edge_marker[id_to]][marker_pos[id_to]] = id_to;
+    }
+    MoveFields(1, id_from, id_to);
+    adjacent[id_to] = adjacent[id_from];
+    for(unsigned int t : adjacent[id_to]){
+      Dirty(2, t);
+      for(Edge &e : triangles[t].edges)
+        if(e.id==id_from) e.id = id_to;
+    }
+  }
+  void TriangularMesh::MovePoint(unsigned int id_from, unsigned int id_to){
+      //sposta il punto id_from nella posizione id_to (lasciata libera). i triangoli che lo contengono
+      //discendono dalle bisezioni che lo hanno creato: si visitano solo quei sottoalberi
+    if(id_from==id_to) return;
+    Point p(points[id_from]);
+    points[id_to] = p;
+    points[id_to].id = id_to;
+    Dirty(0, id_to);
+    if(!metric.empty()) metric[id_to] = metric[id_from];
+    point_marker[id_to] = point_marker[id_from];
+    MoveFields(0, id_from, id_to);
+    tree.RenamePoint(id_from, id_to);
+    vector<unsigned int> stack;
+    for(unsigned int j=0; j<2; j++)
+      if(tree.point_nodes[2*id_to+j]!=UINT_MAX) stack.push_back(tree.point_nodes[2*id_to+j]);
+    while(!stack.empty()){
+      unsigned int node = stack.back();
+      stack.pop_back();
+      if(!tree.IsLeaf(node)){
+        stack.push_back(tree.child[node]);
+        stack.push_back(tree.child[node]+1);
+        continue;
+      }
+      Triangle &T = triangles[tree.triangle[node]];
+      if(!T.Includes(p)) continue;
+      Dirty(2, T.id);
+      for(Point &pt : T.points)
+        if(pt.id==id_from) pt.id = id_to;
+      for(Edge &e : T.edges){
+        if(e.p1.id==id_from) e.p1.id = id_to;
+        if(e.p2.id==id_from) e.p2.id = id_to;
+        edges[e.id] = e;
+        Dirty(1, e.id);
+      }
+    }
+  }
+    //Journal (Mesh)
+  void TriangularMesh::RecordJournal(bool record){
+      //inizia (o interrompe) la registrazione delle bisezioni a partire dalla mesh attuale
+    if(record && !record_journal){
+      journal.clear();
+      journal_base = {nPoints, nEdges, nTriangles};
+    }
+    record_journal = record;
+  }
+  void TriangularMesh::ExportJournal(const string path){
+      //scrive il giornale binario: intestazione (mesh di partenza e parametri) e un record per bisezione.
+      //interi e double nell'ordine dei byte della macchina, indicato dal segno 0x01020304 dopo la versione
+    ofstream file(path, ios::binary);
+    if(file.fail()){cerr<<"Error in export journal"<<endl; throw(1);}
+    uint32_t header[6] = {0x4c4e4a52, 2, 0x01020304, journal_base[0], journal_base[1], journal_base[2]};  // "RJNL", versione
+    file.write((char*)header, sizeof(header));
+    file.write((char*)&theta, sizeof(theta));
+    for(const string &str : {level, uniformity}){
+      uint32_t len = str.size();
+      file.write((char*)&len, sizeof(len));
+      file.write(str.data(), len);
+    }
+    uint64_t n = journal.size();
+    file.write((char*)&n, sizeof(n));
+    file.write((char*)journal.data(), n*sizeof(JournalRecord));
+    file.close();
+    if(file.fail()){cerr<<"Error in export journal"<<endl; throw(1);}
+  }
+  void TriangularMesh::ReplayJournal(const string path){
+      //riapplica il giornale alla mesh di partenza appena importata: nessun ordinamento, nessuna top_theta
+      //e nessun confronto fra lunghezze. lunghezze e conteggi sono controllati con la dimensione del file, gli id
+      //letti con la mesh attuale prima di usarli e gli id creati record per record
+    ifstream file(path, ios::binary | ios::ate);
+    if(file.fail()){cerr<<"Error in import journal"<<endl; throw(1);}
+    uint64_t remaining = file.tellg();
+    file.seekg(0);
+    auto read = [&](void *data, uint64_t bytes){
+      if(bytes>remaining){cerr<<"Error: truncated journal"<<endl; throw(1);}
+      file.read((char*)data, bytes);
+      remaining -= bytes;
+    };
+    uint32_t header[6];
+    read(header, sizeof(header));
+    if(!file || header[0]!=0x4c4e4a52 || header[1]!=2){cerr<<"Error: not a valid journal"<<endl; throw(1);}
+    if(header[2]!=0x01020304){cerr<<"Error: journal written on a different platform"<<endl; throw(1);}
+    if(header[3]!=nPoints || header[4]!=nEdges || header[5]!=nTriangles){cerr<<"Error: journal recorded on a different mesh"<<endl; throw(1);}
+    double recorded_theta;
+    read(&recorded_theta, sizeof(recorded_theta));
+    array<string,2> strings;
+    for(string &str : strings){
+      uint32_t len;
+      read(&len, sizeof(len));
+      if(len>remaining){cerr<<"Error: truncated journal"<<endl; throw(1);}
+      str.resize(len);
+      read(&str[0], len);
+    }
+    uint64_t n;
+    read(&n, sizeof(n));
+    if(n>remaining/sizeof(JournalRecord)){cerr<<"Error: truncated journal"<<endl; throw(1);}
+    vector<JournalRecord> records(n);
+    read(records.data(), n*sizeof(JournalRecord));
+    if(!file){cerr<<"Error: truncated journal"<<endl; throw(1);}
+    file.close();
+    theta = recorded_theta;
+    thetas = {theta};
+    level = strings[0];
+    uniformity = strings[1];
+      //stesse etichette di Refining: i triangoli di partenza non divisi devono avere il lato di raffinamento registrato
+    if(level=="newest") LabelNewest();
 
+    points.reserve(nPoints+n); edges.reserve(nEdges+2*n); triangles.reserve(nTriangles+n); adjacent.reserve(nRows+2*n);
+    auto valid_order = [](uint8_t order){return (order & 3)<3 && ((order>>2) & 3)<3 && ((order>>4) & 3)<3 && (order>>6)==0;};
+    for(const JournalRecord &r : records){
+      bool valid = r.triangle<nTriangles && r.a<nPoints && r.b<nPoints && r.a!=r.b &&
+                   (r.split || (r.split_a<nEdges && r.split_b<nEdges)) && valid_order(r.order_a) && valid_order(r.order_b);
+      for(unsigned int id : {r.a, r.b})
+        if(valid){
+          const array<Point,3> &p = triangles[r.triangle].points;
+          valid = (p[0].id==id || p[1].id==id || p[2].id==id);
+        }
+      if(!valid){cerr<<"Error: journal does not match the mesh"<<endl; throw(1);}
+      Triangle T(triangles[r.triangle]), newTriangle_a, newTriangle_b;
+      Edge Split_a, Split_b;
+      Split_a.id = UINT_MAX;
+      if(!r.split){Split_a = edges[r.split_a]; Split_b = edges[r.split_b];}
+      BisectTriangle(T, points[r.a], points[r.b], Split_a, Split_b, newTriangle_a, newTriangle_b, &r);
+      if(Split_a.p2.id!=r.point || Split_b.id!=r.split_b || newTriangle_b.id!=r.new_triangle)
+        {cerr<<"Error: journal does not match the mesh"<<endl; throw(1);}
+    }
+    AdjustSize();
+  }
+}
@@ -2,7 +2,19 @@
 #define __MESH_H
 
 #include <iostream>
+#include <functional>
+#include <cstdint>
+#include <type_traits>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
 #include "Eigen/Eigen"
+#include "mesh_io.hpp"
 
 using namespace std;
 using namespace Eigen;
@@ -22,12 +34,11 @@ namespace ProjectLibrary
 
     Point() = default;
     Point(const double x, const double y, const unsigned int id): x(x), y(y), id(id) {}
-    Point(const Point& p): x(p.x), y(p.y), id(p.id){}
-    Point& operator=(const Point &p){x = p.x; y = p.y; id = p.id; return *this;}
   };
 
   inline double normSquared(const double& x, const double& y) {return x * x + y * y;}
   bool UpperLine(const Point& p1, const Point& p2, const Point& p3);
+  bool InTriangle(const Point& p, const array<Point,3>& T);
 
   inline bool operator==(const Point p1, const Point p2)
   {return (normSquared(p1.x - p2.x, p1.y - p2.y) <= Point::geometricTol * Point::geometricTol * max(normSquared(p1.x, p1.y), normSquared(p2.x, p2.y)));}
@@ -47,8 +58,6 @@ namespace ProjectLibrary
       if(p1==p2){cerr<<"Error: inconsistent edge"<<endl; throw(1);}
       length = sqrt(pow(abs(p1.x-p2.x),2)+pow(abs(p1.y-p2.y),2));
     }
-    Edge(const Edge &E):p1(E.p1), p2(E.p2), id(E.id), length(E.length){}
-    Edge& operator=(const Edge &E){p1 = E.p1; p2=E.p2; id = E.id; length=E.length; return *this;}
     bool Includes(const Point p){return (p==p1 || p==p2);}
     Point Medium(unsigned int id_p) {return Point((p1.x+p2.x)*0.5,(p1.y+p2.y)*0.5,id_p);}
 
@@ -63,14 +72,13 @@ namespace ProjectLibrary
   struct Triangle
   {
     array<Point,3> points;
-    vector<Edge> edges;
+    array<Edge,3> edges;
     unsigned int id;
     double area;
 
     Triangle() = default;
-    Triangle(vector<Edge> edges, unsigned int id);
-    Triangle(const Triangle &T): points(T.points), edges(T.edges), id(T.id), area(T.area){}
-    Triangle& operator=(const Triangle &T){points=T.points; edges=T.edges; id=T.id; area=T.area; return *this;}
+    Triangle(array<Edge,3> edges, unsigned int id): Triangle(edges, id, true){}
+    Triangle(array<Edge,3> edges, unsigned int id, bool sorted);
     bool Includes(const Edge E){for(Edge &edge : edges) if(edge==E) return true; return false;}
     bool Includes(const Point p){for(Point &pt : points) if(pt==p) return true; return false;}
     Point Opposite(Edge E);
@@ -102,8 +110,185 @@ namespace ProjectLibrary
   }
   inline bool operator!=(const Triangle T1, const Triangle T2){return !(T1==T2);}
 
+    //punti, lati e triangoli non allocano memoria: i vettori della mesh si copiano come blocchi contigui
+  static_assert(is_trivially_copyable<Point>::value && is_trivially_copyable<Edge>::value && is_trivially_copyable<Triangle>::value,
+                "mesh entities must be trivially copyable");
+
+  struct MarkedTriangle: Triangle
+  {
+      //triangolo con il valore dell'indicatore usato per la marcatura (top_theta)
+    double mark;
+    MarkedTriangle() = default;
+    MarkedTriangle(const Triangle &T, double mark): Triangle(T), mark(mark){}
+  };
+  inline bool operator>(const MarkedTriangle T1, const MarkedTriangle T2){return T1.mark > T2.mark + Point::geometricTol_Squared * max(abs(T1.mark), abs(T2.mark));}
+  inline bool operator<=(const MarkedTriangle T1, const MarkedTriangle T2){return !(T1 > T2);}
+
+  struct Indicator
+  {
+      //indicatore per triangolo: vengono divisi i triangoli con valore maggiore (default: area).
+      //batch riceve i baricentri in due vettori separati (x, y) a blocchi di block elementi e scrive i valori;
+      //con threads>1 i blocchi sono divisi tra più thread, quindi batch deve essere rientrante.
+      //values: un valore per triangolo (indice = id); i figli ereditano il valore in proporzione all'area
+    function<void(const double *x, const double *y, double *value, unsigned int n)> batch;
+    vector<double> values;
+    unsigned int threads=1;
+    unsigned int block=1024;
+
+    static Indicator Area(){return Indicator();}
+    static Indicator Batch(function<void(const double*, const double*, double*, unsigned int)> f, unsigned int threads=1);
+    static Indicator Pointwise(function<double(double, double)> f, unsigned int threads=1);
+    static Indicator Values(vector<double> values);
+  };
+
+  struct Region
+  {
+      //regione di raffinamento: rettangolo (vertices = 2 angoli opposti), cerchio (centro e raggio),
+      //poligono chiuso o spezzata aperta (es. una frattura o un'interfaccia)
+    enum Kind {box, circle, polygon, polyline} kind;
+    vector<Point> vertices;
+    double radius=0;
+
+    static Region Box(double x_min, double y_min, double x_max, double y_max);
+    static Region Circle(double x, double y, double radius);
+    static Region Polygon(vector<Point> vertices);
+    static Region Polyline(vector<Point> vertices);
+    array<double,4> Bounds() const;  //x_min, y_min, x_max, y_max
+    bool Intersects(const array<Point,3> &T) const;
+  };
+
+  template<class T> inline size_t Bytes(const vector<T> &v){return v.capacity()*sizeof(T);}  //memoria allocata dal vettore
+
+  struct TriangleGrid
+  {
+      //griglia uniforme sui riquadri dei triangoli: ogni cella contiene gli id dei triangoli il cui riquadro la tocca.
+      //aggiornata a ogni bisezione e coarsening toccando solo le celle dei triangoli cambiati
+    array<double,4> bounds;
+    unsigned int nx=0, ny=0;
+    double dx, dy;
+    vector<vector<unsigned int>> cells;
+    vector<unsigned int> stamp;  //ultima ricerca in cui il triangolo è stato restituito (niente duplicati)
+    unsigned int query=0;
+    size_t cell_bytes=0;  //capacità totale dei vettori delle celle, aggiornata a ogni inserimento
+
+    bool Built() const {return !cells.empty();}
+    void Clear(){cells.clear(); stamp.clear(); nx=ny=0; cell_bytes=0;}
+    size_t MemoryUsage() const {return Bytes(cells)+cell_bytes+Bytes(stamp);}
+    void Push(vector<unsigned int> &cell, unsigned int id);
+    void Build(const vector<Triangle> &triangles, unsigned int nTriangles);
+    void Insert(const Triangle &T);
+    void Remove(const Triangle &T);
+    void Shrink(const Triangle &T, const Triangle &child);
+    void Grow(const Triangle &T);
+    void Rename(const Triangle &T, unsigned int id_to);
+    unsigned int Index(double v, unsigned int axis) const;
+    array<unsigned int,4> Span(const Triangle &T) const;  //celle i0, i1, j0, j1 toccate dal riquadro
+    const vector<unsigned int>& At(double x, double y) const;
+    vector<unsigned int> Query(const array<double,4> &box);
+  };
+
+  struct MeshField
+  {
+      //campo con nome su punti, lati o triangoli: un valore per id.
+      //extensive: nelle bisezioni il valore di un lato o triangolo viene diviso tra le parti (lunghezza o area),
+      //altrimenti viene copiato. sui punti medi il valore è sempre interpolato linearmente.
+      //il lato aggiunto da una bisezione vale 0 per i campi estensivi, la media dei lati del padre per gli altri
+    vector<double> values;
+    bool extensive=false;
+  };
+
+  struct RefiningOptions
+  {
+      //limiti del raffinamento, controllati tra una divisione e l'altra (la mesh resta conforme):
+      //tempo in millisecondi, memoria in byte (MemoryUsage), 0 = nessun limite.
+      //progress viene chiamata ogni progress_every bisezioni con il numero di bisezioni e di triangoli ancora marcati
+    double time_budget=0;
+    size_t memory_budget=0;
+    function<void(unsigned int splits, unsigned int remaining)> progress;
+    unsigned int progress_every=1000;
+    const atomic<bool> *cancel=nullptr;
+  };
+
+  struct SharedBudget
+  {
+      //budget comune alle parti di RefiningParallel: byte di tutte le parti e un unico istante di partenza
+    atomic<size_t> bytes{0};
+    chrono::steady_clock::time_point start;
+  };
+
+  struct AdjacentRow
+  {
+      //riga della matrice di adiacenza: i (al più 2) triangoli che condividono un lato, in spazio fisso
+    array<unsigned int,2> t;
+    unsigned int n=0;
+
+    unsigned int size() const {return n;}
+    bool empty() const {return n==0;}
+    unsigned int& operator[](unsigned int i){return t[i];}
+    unsigned int operator[](unsigned int i) const {return t[i];}
+    unsigned int* begin(){return t.data();}
+    unsigned int* end(){return t.data()+n;}
+    const unsigned int* begin() const {return t.data();}
+    const unsigned int* end() const {return t.data()+n;}
+    void push_back(unsigned int id_t){
+      if(n==2){cerr<<"Error: more than two triangles on an edge"<<endl; throw(1);}
+      t[n++] = id_t;
+    }
+    AdjacentRow& operator=(const vector<unsigned int> &v){n=0; for(unsigned int id_t : v) push_back(id_t); return *this;}
+  };
+
+  struct RefinementTree
+  {
+      //foresta delle bisezioni in vettori piatti: un nodo per ogni triangolo creato, le radici sono i triangoli
+      //di partenza. gli id dei triangoli vengono riutilizzati, quindi il nodo identifica la versione del triangolo.
+      //i due figli di un nodo sono consecutivi (child e child+1, il primo mantiene l'id del padre)
+    vector<unsigned int> triangle;
+    vector<unsigned int> parent;
+    vector<unsigned int> root;
+    vector<unsigned int> level;
+    vector<unsigned int> child;
+    vector<unsigned int> edge;      //lato diviso (id al momento della bisezione)
+    vector<unsigned int> midpoint;  //punto medio creato dalla bisezione
+    vector<unsigned int> leaf;      //nodo foglia corrente di ogni triangolo
+    vector<unsigned int> point_nodes;  //per ogni punto medio i (al più 2) nodi divisi in quel punto: 2*id, 2*id+1
+    vector<unsigned int> free_nodes;   //coppie di nodi liberate dalla coarsening, riutilizzate da Bisect
+    vector<unsigned int> mergeable;    //punti medi le cui bisezioni (1 o 2) hanno solo figli foglia: i candidati della coarsening
+    vector<unsigned int> mergeable_pos;  //posizione di ogni punto medio in mergeable (UINT_MAX se non c'è)
+    vector<unsigned int> level_start, level_nodes;  //nodi ordinati per livello (costruiti su richiesta)
+    size_t MemoryUsage() const;
+
+    void Init(unsigned int nTriangles);
+    void Bisect(unsigned int id_t, unsigned int id_new, unsigned int id_edge, unsigned int id_point);
+    void Merge(unsigned int node, unsigned int id_t);
+    void RenamePoint(unsigned int id_from, unsigned int id_to);
+    bool Mergeable(unsigned int id_point) const;
+    void CheckMergeable(unsigned int id_point);
+    unsigned int Size() const {return triangle.size();}
+    bool Alive(unsigned int node) const {return triangle[node]!=UINT_MAX;}
+    bool IsLeaf(unsigned int node) const {return child[node]==UINT_MAX && Alive(node);}
+    unsigned int Parent(unsigned int node) const {return parent[node];}
+    unsigned int Root(unsigned int node) const {return root[node];}
+    unsigned int Sibling(unsigned int node) const {return (node==child[parent[node]])? node+1 : node-1;}
+    unsigned int Ancestor(unsigned int node, unsigned int l) const {while(level[node]>l) node=parent[node]; return node;}
+    unsigned int Levels(){if(level_start.empty()) BuildLevels(); return level_start.size()-1;}
+    void BuildLevels();
+    vector<unsigned int> NodesAtLevel(unsigned int l);
+  };
+
+  struct JournalRecord
+  {
+      //una bisezione: triangolo diviso, estremi a e b del lato (il figlio dalla parte di a mantiene l'id),
+      //metà del lato già esistenti (split=0) o create ora (split=1), id creati e ordine dei lati dei figli
+      //(2 bit per lato: 0 lato aggiunto, 1 metà, 2 lato esterno)
+    uint32_t triangle, a, b, split_a, split_b;
+    uint32_t point, add, new_triangle;
+    uint8_t split, order_a, order_b, pad;
+  };
+
   class TriangularMesh
   {
+    friend class VirtualMesh;
+
     protected:
       unsigned int nPoints=0;
       vector<Point> points;
@@ -111,19 +296,74 @@ namespace ProjectLibrary
       vector<Edge> edges;
       unsigned int nTriangles=0;
       vector<Triangle> triangles;
-      vector<vector<unsigned int>> adjacent;
+      vector<AdjacentRow> adjacent;
       unsigned int nRows=0;
-      vector<Triangle> top_theta; //si può ottimizzare salvando solo gli id
-      double theta;
-      unsigned int n_theta;
+      vector<MarkedTriangle> top_theta; //si può ottimizzare salvando solo gli id
+      Indicator indicator;
+      vector<double> marks;  //valore dell'indicatore per triangolo (id), solo durante il raffinamento
+      TriangleGrid grid;
+      bool record_bisected=false;
+      vector<unsigned int> bisected;  //id dei figli di ogni bisezione (raffinamento per regione)
+      vector<double> sample_x, sample_y;  //campioni del raffinamento per densità
+      vector<vector<unsigned int>> bins;  //indici dei campioni contenuti in ogni triangolo (id)
+      size_t bin_bytes=0;  //capacità totale dei vettori di bins, aggiornata a ogni modifica
+      vector<array<double,3>> metric;  //tensore metrico simmetrico per punto (id): m11, m12, m22
+      function<array<double,3>(double, double)> metric_function;
+      vector<double> metric_length;  //lunghezza dei lati (id) nella metrica
+      vector<unsigned int> point_marker, edge_marker;  //marker di bordo (0 = interno), ereditati nelle bisezioni
+      vector<vector<unsigned int>> marker_edges;  //id dei lati per valore del marker (diverso da 0)
+      vector<unsigned int> marker_pos;  //posizione di ogni lato marcato (id) nella sua lista di marker_edges
+      array<map<string, MeshField>, 3> fields;  //campi su punti, lati, triangoli
+      RefiningOptions options;
+      string stopped;  //motivo dell'interruzione dell'ultimo raffinamento ("time", "memory", "cancel") o vuoto
+      unsigned int splits=0, next_progress=0;
+      chrono::steady_clock::time_point start;
+      SharedBudget *shared_budget=nullptr;  //solo nelle parti di RefiningParallel
+      size_t shared_bytes=0;  //byte di questa parte già sommati in shared_budget
+      double theta=0;
+      vector<double> thetas;  //percentuali dei raffinamenti successivi (Refining e ResumeRefining)
+      unsigned int n_theta=0;
       short int test;
       string level;
       string uniformity="";
+      bool newest_labels=false;
+      bool record_tree=false;
+      RefinementTree tree;
+      bool record_journal=false;
+      vector<JournalRecord> journal;
+      array<uint32_t,3> journal_base;  //numero di punti, lati e triangoli prima del primo record
+      bool record_delta=false, delta_all=false;  //delta_all: al prossimo passo tutte le entità sono da scrivere
+      array<vector<uint8_t>,3> delta_flags;  //punti, lati, triangoli modificati dall'ultima ExportDelta
+      array<vector<unsigned int>,3> delta_ids;
+      unsigned int delta_steps=0;
 
     public:
       TriangularMesh() = default;
-      TriangularMesh(const string cell0D, const string cell1D, const string cell2D, short int test);
-      void Refining(double theta, string level="base", string uniformity="non-uniform");
+      TriangularMesh(const string cell0D, const string cell1D, const string cell2D, short int test, unsigned int threads=0, bool cache=false);
+      TriangularMesh(const string mesh, short int test, unsigned int step=UINT_MAX);
+      TriangularMesh Clone() const;
+      void Refining(double theta, string level="base", string uniformity="non-uniform", Indicator indicator=Indicator());
+      void ResumeRefining(double theta, Indicator indicator=Indicator());
+        //una componente connessa per thread: il risultato ha gli stessi triangoli di Refining ma gli id sono rinumerati
+        //per componente (prima tutti i punti, lati e triangoli della prima, poi della seconda, ...).
+        //solo non-uniform e senza Options().progress; i budget di tempo e memoria valgono per la mesh intera
+      void RefiningParallel(double theta, string level="base", string uniformity="non-uniform", unsigned int threads=0, Indicator indicator=Indicator());
+      vector<unsigned int> Components(unsigned int &nComponents);
+      unsigned int RefiningRegion(const Region &region, double min_area, string level="base");
+      unsigned int RefiningDensity(const string samples, unsigned int k, string level="base", double min_area=1e-12);
+      unsigned int RefiningDensity(const vector<double> &x, const vector<double> &y, unsigned int k, string level="base", double min_area=1e-12);
+      vector<unsigned int> Density();
+      void SetMetric(vector<array<double,3>> metric);
+      void SetMetric(function<array<double,3>(double, double)> f);
+      void ClearMetric();
+      double MetricLength(unsigned int id_e){return metric_length[id_e];}
+      unsigned int PointMarker(unsigned int id_p){return point_marker[id_p];}
+      unsigned int EdgeMarker(unsigned int id_e){return edge_marker[id_e];}
+      vector<unsigned int> MarkedEdges(unsigned int marker){return (marker<marker_edges.size())? marker_edges[marker] : vector<unsigned int>();}
+      unsigned int RefiningBoundary(vector<unsigned int> markers, unsigned int layers, string level="base");
+      void AddField(string entity, string name, vector<double> values, bool extensive=false);
+      vector<double>& GetField(string entity, string name);
+      void RemoveField(string entity, string name){fields[Entity(entity)].erase(name);}
       void AddPoint(Point point, unsigned int indice=UINT_MAX);
       void AddEdge(Edge edge, unsigned int indice=UINT_MAX);
       void AddTriangle(Triangle triangle, unsigned int indice=UINT_MAX);
@@ -131,14 +371,38 @@ namespace ProjectLibrary
       Edge FindEdge(Point p1, Point p2);
       Edge FindEdge(unsigned int id_e);
       Point FindPoint(unsigned int id_p);
+      Triangle FindTriangle(unsigned int id_t){return triangles[id_t];}
       bool IsAdjacent(Triangle &T,Edge &E){return T.Includes(E);}
       Triangle FindAdjacence(Triangle &T, Edge E);
-      void ExportMesh(vector<short int> cells={0}, string all="");
-      void ExportParaviewfile();
+      bool Conforming();
+        //la coarsening annulla solo le bisezioni registrate: RecordTree va chiamata prima dei raffinamenti da annullare.
+        //ogni chiamata costa in proporzione alle coppie di fratelli unibili e ai triangoli cambiati, non alla mesh
+      void RecordTree(bool record=true){record_tree=record; if(record && tree.Size()==0) tree.Init(nTriangles);}
+      unsigned int Coarsening(function<bool(const Triangle&)> criterion);
+      void RecordJournal(bool record=true);
+      void ExportJournal(const string path);
+      void ReplayJournal(const string path);
+      RefinementTree& Tree(){return tree;}
+      RefiningOptions& Options(){return options;}
+      string Stopped(){return stopped;}
+      size_t MemoryUsage();
+      unsigned int NumberPoints(){return nPoints;}
+      unsigned int NumberEdges(){return nEdges;}
+      unsigned int NumberTriangles(){return nTriangles;}
+      void ExportMesh(vector<short int> cells={0}, string all="", unsigned int threads=0);
+      void ExportBinary(const string path);
+      void ExportArchive(const string path, bool xor_coordinates=true);
+      void RecordDelta(bool record=true);
+      void ExportDelta(const string path);
+      static unsigned int DeltaSteps(const string mesh, short int test);
+      void ExportParaviewfile(unsigned int threads=0);
       void ExportVTK();
-      void ExportMatrix();
+      void ExportVTKBinary(bool cell_data=true);
+      void ExportMatrix(unsigned int threads=0);
       void Show(){
-        cout<<"Test: "<<test<<" ;  Ref.Percentage: "<<theta*100<<" ;  Uniformity: "<<uniformity<<endl;
+        cout<<"Test: "<<test<<" ;  Ref.Percentage: ";
+        for(unsigned int i=0; i<thetas.size(); i++) cout<<((i)? " + " : "")<<thetas[i]*100;
+        cout<<" ;  Uniformity: "<<uniformity<<endl;
         cout<<"Nr triangles: "<<nTriangles<<" ;  Average Area: "<<AvgArea()<<" ;  Variance (Area): "<<Variance()<<endl;
       }
       double AvgArea(unsigned int exp=1){
@@ -156,26 +420,102 @@ namespace ProjectLibrary
       }
 
     private:
-      bool ImportCell0D(const string cell0D);
-      bool ImportCell1D(const string cell1D);
-      bool ImportCell2D(const string cell2D);
-      void ExportCell0D(ostream& out);
-      void ExportCell1D(ostream& out);
-      void ExportCell2D(ostream& out);
+      bool ImportCell0D(const Table &table);
+      bool ImportCell1D(const Table &table, unsigned int threads);
+      bool ImportCell2D(const Table &table, unsigned int threads, bool sorted=true);
+      void ExportCell0D(TextWriter& out, unsigned int begin, unsigned int end);
+      void ExportCell1D(TextWriter& out, unsigned int begin, unsigned int end);
+      void ExportCell2D(TextWriter& out, unsigned int begin, unsigned int end);
+      void ReadBinary(const char *begin, const char *end);
+      void ReadArchive(const char *begin, const char *end);
+      void ReadDelta(const char *begin, const char *end, unsigned int step);
+      void Dirty(unsigned int entity, unsigned int id){
+        if(!record_delta || delta_all) return;
+        vector<uint8_t> &flags = delta_flags[entity];
+        if(id>=flags.size()) flags.resize(2*id+1, 0);
+        if(!flags[id]){flags[id] = 1; delta_ids[entity].push_back(id);}
+      }
+      void DirtyAll(){delta_all = true;}
+      void WriteBinary(ostream &file);
+      bool ReadCache(const string cache_path, const array<string,3> &paths, array<FileKey,3> &keys);
+      void WriteCache(const string cache_path, const array<FileKey,3> &keys);
 
       void AdjacenceMatrix();
       void InsertRow(const vector<unsigned int> &t, unsigned int id_edge=UINT_MAX);
       void ModifyRow(unsigned int id_t_old, unsigned int id_t_new, unsigned int id_edge);
       void AddCol(unsigned int id_tr, unsigned int id_edge);
+      void Refine();
+      void RefineLoop();
+      TriangularMesh SubMesh(const vector<unsigned int> &ids_t);
+      void AppendMesh(const TriangularMesh &S);
+      void StartBudget();
+      bool Budget(unsigned int remaining);
+      size_t Usage();
+      void MarkTriangles();
+      void EvaluateIndicator(const vector<unsigned int> &ids);
+      void MarkChildren(const Triangle &T, const Triangle &newTriangle_a, const Triangle &newTriangle_b);
+      void BinSamples();
+      void ApplyMetric();
+      void SetMarker(vector<unsigned int> &markers, unsigned int id, unsigned int marker);
+      unsigned int Entity(string entity);
+      void SplitFields(const Triangle &T, const Edge &E, const Point &a, const Point &b, const Point &medio, bool split,
+                       const Edge &add, const Edge &split_b, const Triangle &newTriangle_a, const Triangle &newTriangle_b);
+      void MoveFields(unsigned int entity, unsigned int id_from, unsigned int id_to);
+      void MarkerEdges();
+      double MetricLength(const Edge &E);
+      bool MetricLonger(const Edge &E1, const Edge &E2);
+      Triangle Labelled(array<Edge,3> edges, unsigned int id);
+      void SplitBin(const Triangle &newTriangle_a, const Triangle &newTriangle_b);
+      string ThetaTag();
       void DivideTriangle();
       void DivideTriangle_base();
       void DivideTriangle_advanced();
-      void DivideTriangle_recursive(Triangle &T, Point p1, Edge &Split1, Point p2, Edge &Split2, Point &old_m);
+      void DivideTriangle_recursive(Triangle &T, Point p1, Edge &Split1, Point p2, Edge &Split2);
+      void DivideTriangle_newest(Triangle &T);
+      void LabelNewest();
+      void BisectTriangle(Triangle &T, Point a, Point b, Edge &Split_a, Edge &Split_b, Triangle &newTriangle_a, Triangle &newTriangle_b, const JournalRecord *replay=nullptr);
+      Triangle ChildTriangle(Edge add, Edge split, Edge outer, unsigned int id, uint8_t order=UINT8_MAX);
+      void MergeSiblings(unsigned int id_point);
+      void MovePoint(unsigned int id_from, unsigned int id_to);
+      void MoveEdge(unsigned int id_from, unsigned int id_to);
+      void MoveTriangle(unsigned int id_from, unsigned int id_to);
       bool Extract(Triangle &T);
       bool Insert(Triangle &T);
       unsigned int TopTheta();
   };
 
+  class ExportQueue
+  {
+      //coda di esportazione: un thread in background scrive le mesh finite (di cui prende possesso) mentre si raffina
+      //la successiva. le mesh in coda occupano al più max_memory byte (MemoryUsage, tutti i vettori della mesh): Push aspetta che si liberi spazio.
+      //formati: "cell0D", "cell1D", "cell2D", "binary", "archive", "vtk", "binary-vtk", "paraview", "matrix"
+    public:
+      ExportQueue(size_t max_memory=size_t(1)<<30, unsigned int threads=1);
+      ~ExportQueue();
+      ExportQueue(const ExportQueue&) = delete;
+      ExportQueue& operator=(const ExportQueue&) = delete;
+      void Push(TriangularMesh &&mesh, vector<string> formats);
+      void Wait();
+      size_t Queued(){lock_guard<mutex> lock(m); return queued;}
+
+    private:
+      struct Job
+      {
+        TriangularMesh mesh;
+        vector<string> formats;
+        size_t bytes;
+      };
+      deque<Job> jobs;
+      size_t max_memory, queued=0;
+      unsigned int threads;
+      bool stop=false, busy=false;
+      exception_ptr error;
+      mutex m;
+      condition_variable changed;
+      thread writer;
+      void Run();
+      void Write(TriangularMesh &mesh, const vector<string> &formats);
+  };
 }
 
 #endif // __MESH_H
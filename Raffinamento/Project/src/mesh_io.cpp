@@ -0,0 +1,427 @@
+#include "mesh_io.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <exception>
+#include <atomic>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+using namespace std;
+
+namespace ProjectLibrary
+{
+  MappedFile::MappedFile(const string path){
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd<0) return;
+    struct stat info;
+    if(fstat(fd, &info)==0){
+      size = info.st_size;
+      if(size==0) fail = false;
+      else{
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p!=MAP_FAILED){
+          data = static_cast<const char*>(p);
+          mapped = true;
+          fail = false;
+          madvise(p, size, MADV_SEQUENTIAL);
+        }
+      }
+    }
+    close(fd);
+#else
+    ifstream file(path, ios::binary);
+    if(file.fail()) return;
+    ostringstream content;
+    content<<file.rdbuf();
+    buffer = content.str();
+    data = buffer.data();
+    size = buffer.size();
+    fail = false;
+#endif
+  }
+  MappedFile::~MappedFile(){
+#ifndef _WIN32
+    if(mapped) munmap(const_cast<char*>(data), size);
+#endif
+  }
+  size_t MappedFile::Lines() const{
+      //numero di righe (l'ultima può non terminare con '\n')
+    size_t n = 0;
+    for(const char *p = data; p<end(); p++){
+      p = static_cast<const char*>(memchr(p, '\n', end()-p));
+      if(!p) {n++; break;}
+      n++;
+    }
+    return n;
+  }
+
+  inline const char* SkipBlanks(const char *p, const char *end){
+    while(p<end && (*p==' ' || *p=='\t' || *p=='\r')) p++;
+    return p;
+  }
+  const char* ParseUnsigned(const char *p, const char *end, unsigned int &value){
+    p = SkipBlanks(p, end);
+    if(p==end || *p<'0' || *p>'9') return nullptr;
+    uint64_t v = 0;
+    for(; p<end && *p>='0' && *p<='9'; p++){
+      v = v*10 + (*p-'0');
+      if(v>UINT32_MAX) return nullptr;
+    }
+    value = v;
+    return p;
+  }
+  inline double StrtodC(const char *token, char **stop){
+      //strtod con il locale "C": il separatore decimale resta '.' qualunque sia LC_NUMERIC del processo
+#ifndef _WIN32
+    static const locale_t c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+    return strtod_l(token, stop, c_locale);
+#else
+    static const _locale_t c_locale = _create_locale(LC_NUMERIC, "C");
+    return _strtod_l(token, stop, c_locale);
+#endif
+  }
+  const char* ParseDouble(const char *p, const char *end, double &value){
+      //percorso veloce (esatto): mantissa intera al più 2^53 e potenza di 10 al più 22, come nell'algoritmo di Clinger.
+      //negli altri casi il numero viene copiato in un buffer e convertito con strtod nel locale "C"
+      //(senza allocazioni, tranne la prima volta che un thread incontra un numero di oltre 127 caratteri)
+    static const double powers[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+                                    1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+    p = SkipBlanks(p, end);
+    const char *start = p;
+    bool negative = false;
+    if(p<end && (*p=='-' || *p=='+')) negative = (*p++=='-');
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for(; p<end && *p>='0' && *p<='9'; p++, any=true)
+      if(digits<19){mantissa = mantissa*10 + (*p-'0'); if(mantissa) digits++;}
+      else exponent++;
+    if(p<end && *p=='.')
+      for(p++; p<end && *p>='0' && *p<='9'; p++, any=true)
+        if(digits<19){mantissa = mantissa*10 + (*p-'0'); if(mantissa) digits++; exponent--;}
+    if(!any) return nullptr;
+    if(p<end && (*p=='e' || *p=='E')){
+      const char *q = p+1;
+      bool negative_exp = false;
+      if(q<end && (*q=='-' || *q=='+')) negative_exp = (*q++=='-');
+      if(q<end && *q>='0' && *q<='9'){
+        int e = 0;
+        for(; q<end && *q>='0' && *q<='9'; q++) if(e<10000) e = e*10 + (*q-'0');
+        exponent += negative_exp? -e : e;
+        p = q;
+      }
+    }
+    if(p<end && (*p=='x' || *p=='X' || *p=='n' || *p=='N' || *p=='i' || *p=='I')) return nullptr;
+    while(mantissa && mantissa%10==0 && exponent<0){mantissa /= 10; exponent++;}
+    if(digits<19 && mantissa<=(uint64_t(1)<<53) && exponent>=-22 && exponent<=22){
+      double v = double(mantissa);
+      v = (exponent<0)? v/powers[-exponent] : v*powers[exponent];
+      value = negative? -v : v;
+      return p;
+    }
+    char local[128];
+    thread_local vector<char> long_token;  //numeri più lunghi di local: il buffer del thread cresce una volta sola
+    size_t length = p-start;
+    char *token = local;
+    if(length>=sizeof(local)){
+      if(long_token.size()<=length) long_token.resize(length+1);
+      token = long_token.data();
+    }
+    memcpy(token, start, length);
+    token[length] = '\0';
+    char *stop;
+    value = StrtodC(token, &stop);
+    return (stop==token+length)? p : nullptr;
+  }
+  const char* NextLine(const char *p, const char *end){
+    const char *q = static_cast<const char*>(memchr(p, '\n', end-p));
+    return q? q+1 : end;
+  }
+  bool ReadTable(const string path, const string format, unsigned int threads, Table &table){
+      //format: una lettera per colonna, 'u' intero senza segno, 'd' reale. la prima riga è l'intestazione.
+      //il file viene diviso in blocchi che iniziano a capo (almeno 1MB ciascuno): un primo passaggio conta le righe
+      //di ogni blocco, poi ogni blocco viene letto in parallelo direttamente nella sua posizione di table.
+      //le righe vuote vengono saltate; una riga non valida è un errore (la posizione della riga è l'id delle celle)
+    if(format.empty() || format.find_first_not_of("ud")!=string::npos){cerr<<"Error: invalid table format "<<format<<endl; throw(1);}
+    MappedFile file(path);
+    if(file.Fail()) return false;
+    const char *begin = NextLine(file.begin(), file.end()), *end = file.end();
+    const size_t min_chunk = 1<<20;
+    unsigned int chunks = max(1u, min(max(threads, 1u), (unsigned int)((end-begin)/min_chunk)));
+    vector<const char*> bounds(chunks+1, end);
+    bounds[0] = begin;
+    for(unsigned int c=1; c<chunks; c++){
+      const char *p = begin + (end-begin)*c/chunks;
+      bounds[c] = max(bounds[c-1], (p>begin && p[-1]=='\n')? p : NextLine(p, end));
+    }
+    auto run = [&](const function<void(unsigned int)> &f){
+      vector<thread> pool;
+      for(unsigned int c=1; c<chunks; c++) pool.emplace_back(f, c);
+      f(0);
+      for(thread &t : pool) t.join();
+    };
+    size_t nu = count(format.begin(), format.end(), 'u'), nd = format.size()-nu;
+      //righe di ogni blocco (comprese quelle vuote: è un limite superiore) e prima riga di ogni blocco in table
+    vector<size_t> first(chunks+1, 0), rows(chunks, 0);
+    run([&](unsigned int c){
+      size_t n = count(bounds[c], bounds[c+1], '\n');
+      if(bounds[c+1]>bounds[c] && bounds[c+1][-1]!='\n') n++;
+      first[c+1] = n;
+    });
+    for(unsigned int c=0; c<chunks; c++) first[c+1] += first[c];
+    if(first[chunks]>UINT_MAX){cerr<<"Error: "<<path<<" has too many rows"<<endl; throw(1);}
+    table = Table();
+    table.u.resize(first[chunks]*nu);
+    table.d.resize(first[chunks]*nd);
+    vector<const char*> invalid(chunks, nullptr);  //prima riga non valida di ogni blocco
+    run([&](unsigned int c){
+      unsigned int *u = table.u.data()+first[c]*nu;
+      double *d = table.d.data()+first[c]*nd;
+      for(const char *p = bounds[c]; p<bounds[c+1]; p = NextLine(p, bounds[c+1])){
+        const char *q = SkipBlanks(p, bounds[c+1]);
+        if(q==bounds[c+1] || *q=='\n') continue;   //riga vuota
+        for(unsigned int k=0; k<format.size() && q; k++)
+          q = (format[k]=='u')? ParseUnsigned(q, bounds[c+1], *u++) : ParseDouble(q, bounds[c+1], *d++);
+        if(!q){invalid[c] = p; return;}
+        rows[c]++;
+      }
+    });
+    for(const char *p : invalid)
+      if(p){
+        table = Table();
+        size_t line = count(file.begin(), p, '\n')+1;
+        cerr<<"Error: "<<path<<" line "<<line<<" is not a valid row"<<endl; throw(1);
+      }
+      //le righe vuote lasciano un buco in fondo al loro blocco: i blocchi successivi vengono avvicinati sul posto
+    size_t n = 0;
+    for(unsigned int c=0; c<chunks; c++){
+      if(n!=first[c]){
+        memmove(table.u.data()+n*nu, table.u.data()+first[c]*nu, rows[c]*nu*sizeof(unsigned int));
+        memmove(table.d.data()+n*nd, table.d.data()+first[c]*nd, rows[c]*nd*sizeof(double));
+      }
+      n += rows[c];
+    }
+    table.rows = n;
+    table.u.resize(n*nu);
+    table.d.resize(n*nd);
+    return true;
+  }
+  TextWriter::TextWriter(const string path, size_t capacity): buffer(max(capacity, size_t(64))){
+#ifndef _WIN32
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    fail = (fd<0);
+#else
+    file.open(path);
+    fail = file.fail();
+#endif
+  }
+  void TextWriter::Flush(){
+    if(memory) return;
+    if(fail){used = 0; return;}
+#ifndef _WIN32
+    for(size_t done = 0; done<used; ){
+      ssize_t n = write(fd, buffer.data()+done, used-done);
+      if(n<0){fail = true; break;}
+      done += n;
+    }
+#else
+    file.write(buffer.data(), used);
+    fail = file.fail();
+#endif
+    used = 0;
+  }
+  void TextWriter::Close(){
+    Flush();
+#ifndef _WIN32
+    if(fd>=0 && close(fd)!=0) fail = true;
+    fd = -1;
+#else
+    if(file.is_open()){file.close(); fail = fail || file.fail();}
+#endif
+  }
+  TextWriter& TextWriter::Append(const char *data, size_t n){
+    if(!memory && n>buffer.size()){Flush(); buffer.resize(n);}
+    Reserve(n);
+    memcpy(buffer.data()+used, data, n);
+    used += n;
+    return *this;
+  }
+  TextWriter& TextWriter::operator<<(uint64_t value){
+      //cifre scritte da destra in un buffer locale
+    char digits[20];
+    int n = 0;
+    do{digits[19-n++] = '0'+value%10; value /= 10;} while(value);
+    return Append(digits+20-n, n);
+  }
+  TextWriter& TextWriter::operator<<(int value){
+    if(value<0){*this<<'-'; return *this<<uint64_t(-int64_t(value));}
+    return *this<<uint64_t(value);
+  }
+  TextWriter& TextWriter::operator<<(double value){
+    Reserve(32);
+    int n = snprintf(buffer.data()+used, 32, "%.*g", precision, value);
+    if(n>=32){
+      vector<char> big(n+1);
+      snprintf(big.data(), n+1, "%.*g", precision, value);
+      return Append(big.data(), n);
+    }
+    used += n;
+    return *this;
+  }
+  void ArchiveWriter::Double(double value, uint64_t &previous, bool xor_encode){
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    if(!xor_encode){
+      for(unsigned int k=0; k<8; k++) data.push_back(char(bits>>(8*k)));
+      return;
+    }
+    uint64_t x = bits ^ previous;
+    previous = bits;
+    unsigned int lead = 0, trail = 0;
+    while(lead<8 && ((x>>(56-8*lead)) & 0xff)==0) lead++;
+    while(lead+trail<8 && ((x>>(8*trail)) & 0xff)==0) trail++;
+    data.push_back(char(lead<<4 | ((lead==8)? 0 : trail)));
+    for(unsigned int k=trail; k+lead<8; k++) data.push_back(char(x>>(8*k)));
+  }
+  uint64_t ArchiveReader::Varint(){
+    uint64_t value = 0;
+    for(unsigned int shift=0; shift<64; shift+=7){
+      if(p>=end) break;
+      unsigned char c = *p++;
+      value |= uint64_t(c&0x7f)<<shift;
+      if(!(c&0x80)) return value;
+    }
+    fail = true;
+    return 0;
+  }
+  double ArchiveReader::Double(uint64_t &previous, bool xor_encode){
+    uint64_t bits = 0;
+    if(!xor_encode){
+      if(end-p<8){fail = true; return 0;}
+      for(unsigned int k=0; k<8; k++) bits |= uint64_t((unsigned char)*p++)<<(8*k);
+    }
+    else{
+      if(p>=end){fail = true; return 0;}
+      unsigned char c = *p++;
+      unsigned int lead = c>>4, trail = c&15;
+      if(lead>8 || lead+trail>8 || (lead<8 && lead+trail==8) || end-p<int(8-lead-trail)){fail = true; return 0;}
+      uint64_t x = 0;
+      for(unsigned int k=trail; k+lead<8; k++) x |= uint64_t((unsigned char)*p++)<<(8*k);
+      bits = x ^ previous;
+      previous = bits;
+    }
+    double value;
+    memcpy(&value, &bits, 8);
+    return value;
+  }
+  bool ParallelWrite(const string path, const string header, unsigned int n, unsigned int threads,
+                     function<void(TextWriter &out, unsigned int begin, unsigned int end)> format, unsigned int block){
+      //i record [0,n) sono divisi in blocchi formattati in parallelo, ognuno nel proprio buffer; le posizioni nel file
+      //sono la somma prefissa delle lunghezze. si procede a giri di threads blocchi, così la memoria resta limitata:
+      //il file viene esteso alla fine del giro e ogni blocco scritto con pwrite alla sua posizione
+    threads = max(threads, 1u);
+    block = max(block, 1u);
+    vector<TextWriter> parts(threads);
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd<0) return false;
+    atomic<bool> fail(false);
+    auto put = [&](const char *data, size_t size, off_t offset){
+      for(size_t done = 0; done<size; ){
+        ssize_t k = pwrite(fd, data+done, size-done, offset+done);
+        if(k<0){fail = true; return;}
+        done += k;
+      }
+    };
+    put(header.data(), header.size(), 0);
+    off_t offset = header.size();
+#else
+    ofstream file(path);
+    if(file.fail()) return false;
+    file<<header;
+#endif
+    for(unsigned int first = 0; first<n; first += min(n-first, threads*block)){
+      unsigned int count = min(n-first, threads*block);
+      unsigned int used = (count+block-1)/block;
+      ParallelFor(used, threads, [&](unsigned int begin, unsigned int end){
+        for(unsigned int k=begin; k<end; k++){
+          parts[k].Clear();
+          format(parts[k], first+k*block, first+min(count, (k+1)*block));
+        }
+      }, 1);
+#ifndef _WIN32
+      vector<off_t> offsets(used+1, offset);
+      for(unsigned int k=0; k<used; k++) offsets[k+1] = offsets[k]+parts[k].Size();
+      if(ftruncate(fd, offsets[used])!=0) fail = true;
+      ParallelFor(used, threads, [&](unsigned int begin, unsigned int end){
+        for(unsigned int k=begin; k<end; k++) put(parts[k].Data(), parts[k].Size(), offsets[k]);
+      }, 1);
+      offset = offsets[used];
+#else
+      for(unsigned int k=0; k<used; k++) file.write(parts[k].Data(), parts[k].Size());
+#endif
+    }
+#ifndef _WIN32
+    if(close(fd)!=0) fail = true;
+    return !fail;
+#else
+    file.close();
+    return !file.fail();
+#endif
+  }
+  bool StatFile(const string path, FileKey &key){
+    struct stat info;
+    if(stat(path.c_str(), &info)!=0) return false;
+    key.size = info.st_size;
+#if defined(_WIN32)
+    key.mtime = int64_t(info.st_mtime)*1000000000;
+#elif defined(__APPLE__)
+    key.mtime = int64_t(info.st_mtimespec.tv_sec)*1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    key.mtime = int64_t(info.st_mtim.tv_sec)*1000000000 + info.st_mtim.tv_nsec;
+#endif
+    return true;
+  }
+  uint64_t HashFile(const string path){
+      //FNV-1a a 64 bit del contenuto (0 se il file non si apre)
+    MappedFile file(path);
+    if(file.Fail()) return 0;
+    uint64_t hash = 14695981039346656037ull;
+    for(const char *p = file.begin(); p<file.end(); p++){
+      hash ^= (unsigned char)*p;
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+  void ParallelFor(unsigned int n, unsigned int threads, function<void(unsigned int begin, unsigned int end)> body, unsigned int grain){
+      //divide [0,n) in intervalli contigui (almeno grain elementi) tra i thread. la prima eccezione viene rilanciata
+    unsigned int parts = max(1u, min(max(threads, 1u), n/max(grain, 1u)));
+    if(parts==1){body(0, n); return;}
+    vector<exception_ptr> errors(parts);
+    auto run = [&](unsigned int k){
+      try{body(size_t(n)*k/parts, size_t(n)*(k+1)/parts);}
+      catch(...){errors[k] = current_exception();}
+    };
+    vector<thread> pool;
+    for(unsigned int k=1; k<parts; k++) pool.emplace_back(run, k);
+    run(0);
+    for(thread &t : pool) t.join();
+    for(exception_ptr &e : errors)
+      if(e) rethrow_exception(e);
+  }
+}
@@ -0,0 +1,177 @@
+#ifndef __MESH_IO_H
+#define __MESH_IO_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+
+namespace ProjectLibrary
+{
+  class MappedFile
+  {
+      //file mappato in memoria in sola lettura (su Windows viene letto in un buffer)
+    public:
+      MappedFile(const string path);
+      ~MappedFile();
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+      bool Fail() const {return fail;}
+      const char* begin() const {return data;}
+      const char* end() const {return data+size;}
+      size_t Lines() const;
+
+    private:
+      const char *data=nullptr;
+      size_t size=0;
+      bool fail=true;
+      bool mapped=false;
+      string buffer;
+  };
+
+    //parser senza allocazioni e indipendenti dal locale (i reali fuori dal percorso veloce passano per strtod nel locale "C"):
+    //saltano spazi e tabulazioni iniziali, restituiscono il carattere successivo al numero oppure nullptr se non c'è un numero valido
+  const char* ParseUnsigned(const char *p, const char *end, unsigned int &value);
+  const char* ParseDouble(const char *p, const char *end, double &value);
+  const char* NextLine(const char *p, const char *end);
+
+  struct Table
+  {
+      //righe di un file di celle: per ogni riga le colonne intere in u e quelle reali in d (nell'ordine del formato)
+    unsigned int rows=0;
+    vector<unsigned int> u;
+    vector<double> d;
+  };
+  struct MeshHeader
+  {
+      //intestazione del formato binario della mesh (.rmesh), seguita dagli array allineati a 8 byte:
+      //punti, lati, triangoli, [marker di punti e lati], [righe di adiacenza]
+    enum {markers = 1, adjacency = 2};
+    uint32_t magic = 0x48534d52;    // "RMSH"
+    uint32_t version = 1;
+    uint32_t byte_order = 0x01020304;
+    uint32_t flags = 0;
+    uint32_t sizes[4] = {0,0,0,0};  //sizeof di Point, Edge, Triangle, AdjacentRow
+    uint32_t counts[4] = {0,0,0,0}; //punti, lati, triangoli, righe di adiacenza
+  };
+  struct FileKey
+  {
+      //chiave di un file sorgente nella cache di importazione
+    uint64_t size=0;
+    int64_t mtime=0;  //nanosecondi
+    uint64_t hash=0;  //FNV-1a del contenuto
+  };
+  struct CacheHeader
+  {
+      //intestazione della cache di importazione, seguita dalla mesh binaria
+    uint32_t magic = 0x48434352;    // "RCCH"
+    uint32_t version = 1;
+    FileKey keys[3];
+  };
+  bool StatFile(const string path, FileKey &key);
+  uint64_t HashFile(const string path);
+  inline size_t Align8(size_t n){return (n+7)&~size_t(7);}
+  class BigEndianWriter
+  {
+      //scrittura bufferizzata di valori binari in big-endian (formato VTK legacy BINARY)
+    public:
+      BigEndianWriter(ostream &out): out(out) {buffer.reserve(capacity);}
+      ~BigEndianWriter(){Flush();}
+      template<class T> void Put(T value){
+        char bytes[sizeof(T)];
+        memcpy(bytes, &value, sizeof(T));
+        if(little) reverse(bytes, bytes+sizeof(T));
+        buffer.insert(buffer.end(), bytes, bytes+sizeof(T));
+        if(buffer.size()>=capacity) Flush();
+      }
+      void Flush(){out.write(buffer.data(), buffer.size()); buffer.clear();}
+
+    private:
+      static const size_t capacity = 1<<20;
+      ostream &out;
+      vector<char> buffer;
+      bool little = LittleEndian();
+      static bool LittleEndian(){uint16_t one = 1; char c; memcpy(&c, &one, 1); return c==1;}
+  };
+  class TextWriter
+  {
+      //scrittura di testo con un buffer grande: gli interi sono convertiti a mano, i reali con snprintf("%.*g")
+      //(come ostream con la precisione di default), il buffer pieno viene scritto con un'unica chiamata di sistema.
+      //senza file il testo resta in memoria (il buffer cresce) e si legge con Data e Size
+    public:
+      TextWriter(const string path, size_t capacity=1<<22);
+      TextWriter(): buffer(1<<16), fail(false), memory(true) {}
+      ~TextWriter(){Close();}
+      TextWriter(const TextWriter&) = delete;
+      TextWriter& operator=(const TextWriter&) = delete;
+      bool Fail() const {return fail;}
+      void Precision(int digits){precision = digits;}
+      void Flush();
+      void Close();
+      const char* Data() const {return buffer.data();}
+      size_t Size() const {return used;}
+      void Clear(){used = 0;}
+      TextWriter& operator<<(uint64_t value);
+      TextWriter& operator<<(unsigned int value){return *this<<uint64_t(value);}
+      TextWriter& operator<<(int value);
+      TextWriter& operator<<(double value);
+      TextWriter& operator<<(char c){Reserve(1); buffer[used++] = c; return *this;}
+      TextWriter& operator<<(const char *str){return Append(str, strlen(str));}
+      TextWriter& operator<<(const string &str){return Append(str.data(), str.size());}
+
+    private:
+      vector<char> buffer;
+      size_t used = 0;
+      int precision = 6;
+      bool fail = true;
+      bool memory = false;
+#ifndef _WIN32
+      int fd = -1;
+#else
+      ofstream file;
+#endif
+      void Reserve(size_t n){if(used+n>buffer.size()){if(memory) buffer.resize(max(2*buffer.size(), used+n)); else Flush();}}
+      TextWriter& Append(const char *data, size_t n);
+  };
+  class ArchiveWriter
+  {
+      //codifica compatta indipendente dalla piattaforma: interi come varint (LEB128), con segno a zig-zag;
+      //reali grezzi (8 byte little-endian) oppure in XOR con il valore precedente: un byte di controllo con i byte
+      //nulli in testa e in coda, poi solo i byte centrali
+    public:
+      vector<char> data;
+      void Varint(uint64_t value){
+        while(value>=0x80){data.push_back(char(value|0x80)); value >>= 7;}
+        data.push_back(char(value));
+      }
+      void Signed(int64_t value){Varint((uint64_t(value)<<1) ^ uint64_t(value>>63));}
+      void Double(double value, uint64_t &previous, bool xor_encode);
+  };
+  class ArchiveReader
+  {
+      //lettura di ArchiveWriter: dopo il primo errore (dati finiti o non validi) Fail resta vero e i valori sono 0
+    public:
+      ArchiveReader(const char *begin, const char *end): p(begin), end(end) {}
+      bool Fail() const {return fail;}
+      const char* Position() const {return p;}
+      uint64_t Varint();
+      int64_t Signed(){uint64_t v = Varint(); return int64_t(v>>1) ^ -int64_t(v&1);}
+      double Double(uint64_t &previous, bool xor_encode);
+
+    private:
+      const char *p, *end;
+      bool fail = false;
+  };
+  bool ParallelWrite(const string path, const string header, unsigned int n, unsigned int threads,
+                     function<void(TextWriter &out, unsigned int begin, unsigned int end)> format, unsigned int block=1<<16);
+  bool ReadTable(const string path, const string format, unsigned int threads, Table &table);
+  void ParallelFor(unsigned int n, unsigned int threads, function<void(unsigned int begin, unsigned int end)> body, unsigned int grain=4096);
+}
+
+#endif // __MESH_IO_H
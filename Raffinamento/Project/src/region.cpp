@@ -0,0 +1,198 @@
+#include "mesh_classes.hpp"
+
+using namespace std;
+
+namespace ProjectLibrary
+{
+  inline double Cross(const Point &o, const Point &a, const Point &b){return (a.x-o.x)*(b.y-o.y)-(a.y-o.y)*(b.x-o.x);}
+
+  bool InTriangle(const Point &p, const array<Point,3> &T){
+      //punto interno o sul bordo di un triangolo antiorario
+    return Cross(T[0],T[1],p)>=0 && Cross(T[1],T[2],p)>=0 && Cross(T[2],T[0],p)>=0;
+  }
+  bool InPolygon(const Point &p, const vector<Point> &poly){
+      //regola pari-dispari lungo la semiretta orizzontale verso destra
+    bool in = false;
+    for(unsigned int i=0, j=poly.size()-1; i<poly.size(); j=i++)
+      if((poly[i].y>p.y)!=(poly[j].y>p.y) && p.x < poly[j].x+(p.y-poly[j].y)*(poly[i].x-poly[j].x)/(poly[i].y-poly[j].y))
+        in = !in;
+    return in;
+  }
+  bool OnSegment(const Point &p, const Point &a, const Point &b){
+      //p allineato con a e b: controlla che sia compreso tra i due
+    return min(a.x,b.x)<=p.x && p.x<=max(a.x,b.x) && min(a.y,b.y)<=p.y && p.y<=max(a.y,b.y);
+  }
+  bool SegmentsIntersect(const Point &p1, const Point &p2, const Point &q1, const Point &q2){
+    double d1 = Cross(q1,q2,p1), d2 = Cross(q1,q2,p2), d3 = Cross(p1,p2,q1), d4 = Cross(p1,p2,q2);
+    if(((d1>0 && d2<0) || (d1<0 && d2>0)) && ((d3>0 && d4<0) || (d3<0 && d4>0))) return true;
+    return (d1==0 && OnSegment(p1,q1,q2)) || (d2==0 && OnSegment(p2,q1,q2)) ||
+           (d3==0 && OnSegment(q1,p1,p2)) || (d4==0 && OnSegment(q2,p1,p2));
+  }
+  double SegmentDistanceSquared(const Point &p, const Point &a, const Point &b){
+    double lx = b.x-a.x, ly = b.y-a.y;
+    double t = ((p.x-a.x)*lx+(p.y-a.y)*ly)/(lx*lx+ly*ly);
+    t = max(0.0, min(1.0, t));
+    return normSquared(a.x+t*lx-p.x, a.y+t*ly-p.y);
+  }
+
+    //Region
+  Region Region::Box(double x_min, double y_min, double x_max, double y_max){
+    if(x_min>x_max || y_min>y_max){cerr<<"Error: inconsistent box"<<endl; throw(1);}
+    Region R;
+    R.kind = box;
+    R.vertices = {Point(x_min,y_min,0), Point(x_max,y_min,1), Point(x_max,y_max,2), Point(x_min,y_max,3)};
+    return R;
+  }
+  Region Region::Circle(double x, double y, double radius){
+    if(radius<0){cerr<<"Error: negative radius"<<endl; throw(1);}
+    Region R;
+    R.kind = circle;
+    R.vertices = {Point(x,y,0)};
+    R.radius = radius;
+    return R;
+  }
+  Region Region::Polygon(vector<Point> vertices){
+    if(vertices.size()<3){cerr<<"Error: a polygon needs at least 3 vertices"<<endl; throw(1);}
+    Region R;
+    R.kind = polygon;
+    R.vertices = vertices;
+    return R;
+  }
+  Region Region::Polyline(vector<Point> vertices){
+    if(vertices.size()<2){cerr<<"Error: a polyline needs at least 2 vertices"<<endl; throw(1);}
+    Region R;
+    R.kind = polyline;
+    R.vertices = vertices;
+    return R;
+  }
+  array<double,4> Region::Bounds() const{
+    if(kind==circle)
+      return {vertices[0].x-radius, vertices[0].y-radius, vertices[0].x+radius, vertices[0].y+radius};
+    array<double,4> b = {vertices[0].x, vertices[0].y, vertices[0].x, vertices[0].y};
+    for(const Point &p : vertices){
+      b[0] = min(b[0],p.x); b[1] = min(b[1],p.y);
+      b[2] = max(b[2],p.x); b[3] = max(b[3],p.y);
+    }
+    return b;
+  }
+  bool Region::Intersects(const array<Point,3> &T) const{
+      //test esatto tra il triangolo (antiorario) e la regione, bordo compreso
+    if(kind==circle){
+      if(InTriangle(vertices[0],T)) return true;
+      for(unsigned int i=0; i<3; i++)
+        if(SegmentDistanceSquared(vertices[0],T[i],T[(i+1)%3])<=radius*radius) return true;
+      return false;
+    }
+    unsigned int n = vertices.size();
+    unsigned int segments = (kind==polyline)? n-1 : n;
+    for(unsigned int i=0; i<n; i++)
+      if(InTriangle(vertices[i],T)) return true;
+    if(kind!=polyline)
+      for(const Point &p : T)
+        if(InPolygon(p,vertices)) return true;
+    for(unsigned int i=0; i<segments; i++)
+      for(unsigned int j=0; j<3; j++)
+        if(SegmentsIntersect(vertices[i],vertices[(i+1)%n],T[j],T[(j+1)%3])) return true;
+    return false;
+  }
+
+    //TriangleGrid
+  void TriangleGrid::Build(const vector<Triangle> &triangles, unsigned int nTriangles){
+      //circa un triangolo per cella sul riquadro della mesh
+    bounds = {triangles[0].points[0].x, triangles[0].points[0].y, triangles[0].points[0].x, triangles[0].points[0].y};
+    for(unsigned int i=0; i<nTriangles; i++)
+      for(const Point &p : triangles[i].points){
+        bounds[0] = min(bounds[0],p.x); bounds[1] = min(bounds[1],p.y);
+        bounds[2] = max(bounds[2],p.x); bounds[3] = max(bounds[3],p.y);
+      }
+    nx = ny = max(1u, (unsigned int)sqrt(nTriangles));
+    dx = (bounds[2]>bounds[0])? (bounds[2]-bounds[0])/nx : 1;
+    dy = (bounds[3]>bounds[1])? (bounds[3]-bounds[1])/ny : 1;
+    cells.assign(nx*ny, {});
+    cell_bytes = 0;
+    stamp.assign(nTriangles, 0);
+    query = 0;
+    for(unsigned int i=0; i<nTriangles; i++) Insert(triangles[i]);
+  }
+  unsigned int TriangleGrid::Index(double v, unsigned int axis) const{
+      //colonna (axis 0) o riga (axis 1) della coordinata v: limitata alla griglia prima della conversione,
+      //così coordinate enormi o infinite non superano UINT_MAX (NaN va nella prima)
+    double cell = (axis==0)? (v-bounds[0])/dx : (v-bounds[1])/dy;
+    return (unsigned int)min<double>(((axis==0)? nx : ny)-1, max(0.0, cell));
+  }
+  array<unsigned int,4> TriangleGrid::Span(const Triangle &T) const{
+    double x_min = min(T.points[0].x, min(T.points[1].x, T.points[2].x)), x_max = max(T.points[0].x, max(T.points[1].x, T.points[2].x));
+    double y_min = min(T.points[0].y, min(T.points[1].y, T.points[2].y)), y_max = max(T.points[0].y, max(T.points[1].y, T.points[2].y));
+    return {Index(x_min, 0), Index(x_max, 0), Index(y_min, 1), Index(y_max, 1)};
+  }
+  void TriangleGrid::Insert(const Triangle &T){
+    array<unsigned int,4> s = Span(T);
+    for(unsigned int j=s[2]; j<=s[3]; j++)
+      for(unsigned int i=s[0]; i<=s[1]; i++)
+        Push(cells[j*nx+i], T.id);
+    if(T.id>=stamp.size()) stamp.resize(2*T.id+1, 0);
+  }
+  void TriangleGrid::Push(vector<unsigned int> &cell, unsigned int id){
+      //aggiunge l'id alla cella contando la memoria in più se il vettore viene riallocato
+    size_t capacity = cell.capacity();
+    cell.push_back(id);
+    cell_bytes += (cell.capacity()-capacity)*sizeof(unsigned int);
+  }
+  void TriangleGrid::Remove(const Triangle &T){
+      //toglie T dalle sue celle mantenendo l'ordine degli altri id
+    array<unsigned int,4> s = Span(T);
+    for(unsigned int j=s[2]; j<=s[3]; j++)
+      for(unsigned int i=s[0]; i<=s[1]; i++){
+        vector<unsigned int> &cell = cells[j*nx+i];
+        auto it = find(cell.begin(), cell.end(), T.id);
+        if(it!=cell.end()) cell.erase(it);
+      }
+  }
+  void TriangleGrid::Shrink(const Triangle &T, const Triangle &child){
+      //il figlio che mantiene l'id di T resta solo nelle celle del proprio riquadro (contenuto in quello di T)
+    array<unsigned int,4> s = Span(T), c = Span(child);
+    for(unsigned int j=s[2]; j<=s[3]; j++)
+      for(unsigned int i=s[0]; i<=s[1]; i++){
+        if(i>=c[0] && i<=c[1] && j>=c[2] && j<=c[3]) continue;
+        vector<unsigned int> &cell = cells[j*nx+i];
+        auto it = find(cell.begin(), cell.end(), T.id);
+        if(it!=cell.end()) cell.erase(it);
+      }
+  }
+  void TriangleGrid::Grow(const Triangle &T){
+      //T ha ingrandito il riquadro (coarsening): l'id viene aggiunto alle celle che non lo contengono ancora
+    array<unsigned int,4> s = Span(T);
+    for(unsigned int j=s[2]; j<=s[3]; j++)
+      for(unsigned int i=s[0]; i<=s[1]; i++){
+        vector<unsigned int> &cell = cells[j*nx+i];
+        if(find(cell.begin(), cell.end(), T.id)==cell.end()) Push(cell, T.id);
+      }
+    if(T.id>=stamp.size()) stamp.resize(2*T.id+1, 0);
+  }
+  void TriangleGrid::Rename(const Triangle &T, unsigned int id_to){
+    array<unsigned int,4> s = Span(T);
+    for(unsigned int j=s[2]; j<=s[3]; j++)
+      for(unsigned int i=s[0]; i<=s[1]; i++)
+        for(unsigned int &id : cells[j*nx+i])
+          if(id==T.id) id = id_to;
+  }
+  const vector<unsigned int>& TriangleGrid::At(double x, double y) const{
+      //cella che contiene il punto (le celle di bordo si estendono fuori dal riquadro)
+    return cells[Index(y, 1)*nx+Index(x, 0)];
+  }
+  vector<unsigned int> TriangleGrid::Query(const array<double,4> &box){
+      //id dei triangoli con il riquadro in una cella toccata da box (candidati, da controllare con il test esatto)
+    vector<unsigned int> ids;
+    if(box[2]<bounds[0] || box[0]>bounds[2] || box[3]<bounds[1] || box[1]>bounds[3]) return ids;
+    unsigned int i0 = Index(box[0], 0), i1 = Index(box[2], 0), j0 = Index(box[1], 1), j1 = Index(box[3], 1);
+    query++;
+    for(unsigned int j=j0; j<=j1; j++)
+      for(unsigned int i=i0; i<=i1; i++)
+        for(unsigned int id : cells[j*nx+i])
+          if(stamp[id]!=query){
+            stamp[id] = query;
+            ids.push_back(id);
+          }
+    return ids;
+  }
+}
@@ -0,0 +1,225 @@
+#include "virtual_mesh.hpp"
+#include <thread>
+
+using namespace std;
+
+namespace ProjectLibrary
+{
+  VirtualMesh::VirtualMesh(const TriangularMesh &M, unsigned int k): mesh(M), k(k), nBase(M.nTriangles),
+                                                                     nPointsBase(M.nPoints), nEdgesBase(M.nEdges){
+      //controlla che k sia pari e che gli id di punti, lati e triangoli stiano in un unsigned int
+    if(k%2){cerr<<"Error: the virtual mesh needs an even number of levels"<<endl; throw(1);}
+    double segments = pow(2.0,k/2);
+    if(k>=32 || nBase*pow(2.0,k)>=UINT_MAX || nEdgesBase*segments+nBase*1.5*segments*segments>=UINT_MAX)
+      {cerr<<"Error: too many refinement levels"<<endl; throw(1);}
+    n = 1u<<(k/2);
+    nTriangles = nBase<<k;
+    inner_points = (n-1)*(n-2)/2;
+    inner_edges = 3*n*(n-1)/2;
+  }
+  VirtualMesh::Lattice VirtualMesh::Root() const{
+      //triangolo di partenza nel reticolo di passo 1/(2n): points[0],points[1] sono gli estremi di edges[0]
+    return {Node({2*n, 0}), Node({0, 2*n}), Node({0, 0})};
+  }
+  VirtualMesh::Lattice VirtualMesh::Child(const Lattice &T, unsigned int bit){
+      //bisezione dal vertice più recente: il lato di raffinamento del figlio è quello opposto al punto medio.
+      //l'ordine dei vertici resta antiorario. i vertici fino al livello k sono nodi pari, quindi il punto medio è esatto
+    Node m = {(T[0][0]+T[1][0])/2, (T[0][1]+T[1][1])/2};
+    if(bit==0) return {T[2], T[0], m};
+    return {T[1], T[2], m};
+  }
+  unsigned int VirtualMesh::OnEdge(unsigned int parent, const array<unsigned int,3> &w, unsigned int &position) const{
+      //pesi baricentrici w rispetto ai vertici del padre: se uno è nullo restituisce il lato di partenza che contiene il
+      //nodo e in position il peso dell'estremo p2 del lato (la distanza da p1), altrimenti UINT_MAX
+    unsigned int z = (w[0]==0)? 0 : (w[1]==0)? 1 : (w[2]==0)? 2 : 3;
+    if(z==3) return UINT_MAX;
+    const Triangle &T = mesh.triangles[parent];
+    unsigned int i = (z+1)%3, j = (z+2)%3;
+    for(const Edge &e : T.edges)
+      if(e.p1.id==T.points[i].id && e.p2.id==T.points[j].id){position = w[j]; return e.id;}
+      else if(e.p1.id==T.points[j].id && e.p2.id==T.points[i].id){position = w[i]; return e.id;}
+    cerr<<"Error: triangle "<<parent<<" is not consistent with its edges"<<endl; throw(1);
+  }
+  Point VirtualMesh::EdgePoint(unsigned int id_edge, unsigned int position) const{
+      //punto a distanza position/n da p1 sul lato di partenza id_edge
+    const Edge &E = mesh.edges[id_edge];
+    if(position==0) return E.p1;
+    if(position==n) return E.p2;
+    return Point(((n-position)*E.p1.x+position*E.p2.x)/n, ((n-position)*E.p1.y+position*E.p2.y)/n,
+                 nPointsBase+id_edge*(n-1)+position-1);
+  }
+  Point VirtualMesh::InnerPoint(unsigned int parent, unsigned int a, unsigned int b) const{
+      //punto interno di pesi (a,b,n-a-b)/n: righe per a crescente, ognuna con b = 1..n-1-a
+    const array<Point,3> &P = mesh.triangles[parent].points;
+    unsigned int c = n-a-b;
+    unsigned int id = nPointsBase+nEdgesBase*(n-1)+parent*inner_points+(a-1)*(n-1)-(a-1)*a/2+b-1;
+    return Point((a*P[0].x+b*P[1].x+c*P[2].x)/n, (a*P[0].y+b*P[1].y+c*P[2].y)/n, id);
+  }
+  Point VirtualMesh::NodePoint(unsigned int parent, const Node &v) const{
+      //vertice del nodo v del padre: punto di partenza, punto su un lato di partenza o punto interno
+    array<unsigned int,3> w = {v[0]/2, v[1]/2, n-v[0]/2-v[1]/2};
+    for(unsigned int i=0; i<3; i++)
+      if(w[i]==n) return mesh.triangles[parent].points[i];
+    unsigned int position, id_edge = OnEdge(parent, w, position);
+    if(id_edge!=UINT_MAX) return EdgePoint(id_edge, position);
+    return InnerPoint(parent, w[0], w[1]);
+  }
+  static unsigned int RowStart(unsigned int A, unsigned int n){
+      //lati interni con punto medio (A',B') e A'<A: nodi interni del reticolo 2n nelle righe precedenti meno quelli pari
+      //(che sono vertici)
+    unsigned long long N = 2*n, q = (A-1)/2;
+    return (A-1)*(N-1)-(A-1)*(unsigned long long)A/2-(q*(n-1)-q*(q+1)/2);
+  }
+  unsigned int VirtualMesh::NodeEdge(unsigned int parent, const Node &v1, const Node &v2) const{
+      //id del lato di estremi v1, v2 ricavato dal punto medio, che ha almeno una coordinata dispari
+    unsigned int A = (v1[0]+v2[0])/2, B = (v1[1]+v2[1])/2;
+    unsigned int position, id_edge = OnEdge(parent, {A, B, 2*n-A-B}, position);
+    if(id_edge!=UINT_MAX) return id_edge*n+(position-1)/2;
+    return nEdgesBase*n+parent*inner_edges+RowStart(A, n)+((A%2)? B-1 : (B-1)/2);
+  }
+  VirtualMesh::Cell VirtualMesh::MakeCell(unsigned int id, const Lattice &T) const{
+    unsigned int parent = id>>k;
+    Cell cell;
+    cell.id = id;
+    for(unsigned int i=0; i<3; i++){
+      cell.points[i] = NodePoint(parent, T[i]);
+      cell.edges[i] = NodeEdge(parent, T[i], T[(i+1)%3]);
+    }
+    return cell;
+  }
+  VirtualMesh::Cell VirtualMesh::GetTriangle(unsigned int id) const{
+      //calcola il triangolo di id dato scendendo lungo il percorso: O(k)
+    Lattice T = Root();
+    for(unsigned int l=k; l>0; l--)
+      T = Child(T, (id>>(l-1)) & 1);
+    return MakeCell(id, T);
+  }
+  Point VirtualMesh::GetPoint(unsigned int id) const{
+      //inverte la numerazione; per i punti interni la riga si trova per bisezione: O(log n)
+    if(id<nPointsBase) return mesh.points[id];
+    unsigned int r = id-nPointsBase;
+    if(r<nEdgesBase*(n-1)) return EdgePoint(r/(n-1), r%(n-1)+1);
+    r -= nEdgesBase*(n-1);
+    unsigned int parent = r/inner_points;
+    r %= inner_points;
+    unsigned int lo = 1, hi = n-2;  //ultima riga a con inizio (a-1)(n-1)-(a-1)a/2 <= r
+    while(lo<hi){
+      unsigned int a = (lo+hi+1)/2;
+      if((a-1)*(n-1)-(a-1)*a/2<=r) lo = a;
+      else hi = a-1;
+    }
+    return InnerPoint(parent, lo, r-((lo-1)*(n-1)-(lo-1)*lo/2)+1);
+  }
+  Edge VirtualMesh::GetEdge(unsigned int id) const{
+      //i segmenti dei lati di partenza sono diretti; per un lato interno si ricava il punto medio e si scende fino alla
+      //foglia che lo contiene, che ha il lato tra i suoi: O(k)
+    if(id<nEdgesBase*n) return Edge(EdgePoint(id/n, id%n), EdgePoint(id/n, id%n+1), id);
+    unsigned int r = id-nEdgesBase*n;
+    unsigned int parent = r/inner_edges;
+    r %= inner_edges;
+    unsigned int lo = 1, hi = 2*n-2;
+    while(lo<hi){
+      unsigned int A = (lo+hi+1)/2;
+      if(RowStart(A, n)<=r) lo = A;
+      else hi = A-1;
+    }
+    unsigned int A = lo, o = r-RowStart(A, n), B = (A%2)? o+1 : 2*o+1;
+    Lattice T = Root();
+    for(unsigned int l=0; l<k; l++){
+        //il figlio 0 è dalla parte di T[0] rispetto alla bisettrice da T[2] al punto medio (sulla bisettrice va bene l'uno o l'altro)
+      long long ux = (long long)(T[0][0]+T[1][0])/2-T[2][0], uy = (long long)(T[0][1]+T[1][1])/2-T[2][1];
+      long long side_0 = ux*((long long)T[0][1]-T[2][1])-uy*((long long)T[0][0]-T[2][0]);
+      long long side_m = ux*((long long)B-T[2][1])-uy*((long long)A-T[2][0]);
+      T = Child(T, ((side_0>0)==(side_m>0) || side_m==0)? 0 : 1);
+    }
+    for(unsigned int i=0; i<3; i++){
+      const Node &v1 = T[i], &v2 = T[(i+1)%3];
+      if(v1[0]+v2[0]==2*A && v1[1]+v2[1]==2*B) return Edge(NodePoint(parent, v1), NodePoint(parent, v2), id);
+    }
+    cerr<<"Error: edge "<<id<<" not found"<<endl; throw(1);
+  }
+  unsigned int VirtualMesh::PointMarker(unsigned int id) const{
+      //i punti sui lati di partenza ereditano il marker del lato, come nella bisezione
+    if(id<nPointsBase) return mesh.point_marker[id];
+    if(id-nPointsBase<nEdgesBase*(n-1)) return mesh.edge_marker[(id-nPointsBase)/(n-1)];
+    return 0;
+  }
+  unsigned int VirtualMesh::EdgeMarker(unsigned int id) const{
+    return (id<nEdgesBase*n)? mesh.edge_marker[id/n] : 0;
+  }
+    //Iterator
+  VirtualMesh::TriangleIterator::TriangleIterator(const VirtualMesh *mesh, unsigned int parent, unsigned int path):
+    mesh(mesh), parent(parent), path(path){
+    stack.resize(mesh->k+1);
+    if(parent<mesh->nBase){
+      stack[0] = mesh->Root();
+      Descend(0);
+    }
+  }
+  void VirtualMesh::TriangleIterator::Descend(unsigned int from){
+      //ricalcola gli antenati dal livello from in giù
+    unsigned int k = mesh->k;
+    for(unsigned int l=from; l<k; l++)
+      stack[l+1] = Child(stack[l], (path>>(k-1-l)) & 1);
+    cell = mesh->MakeCell((parent<<k) + path, stack[k]);
+  }
+  VirtualMesh::TriangleIterator& VirtualMesh::TriangleIterator::operator++(){
+      //passa alla foglia successiva ricalcolando solo i livelli cambiati: O(1) ammortizzato
+    unsigned int k = mesh->k;
+    path++;
+    if(path==(1u<<k)){
+      path = 0;
+      parent++;
+      if(parent<mesh->nBase) Descend(0);
+      return *this;
+    }
+    unsigned int changed = 0;  //bit meno significativo cambiato = numero di zeri finali di path
+    while(((path>>changed) & 1)==0) changed++;
+    Descend(k-1-changed);
+    return *this;
+  }
+    //Export
+  void VirtualMesh::ExportCell0D(const string path, unsigned int threads) const{
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    if(!ParallelWrite(path, "Id Marker x y\n", NumberPoints(), threads, [this](TextWriter &out, unsigned int begin, unsigned int end){
+      for(unsigned int i=begin; i<end; i++){
+        Point p = GetPoint(i);
+        out<<p.id<<' '<<PointMarker(i)<<' '<<p.x<<' '<<p.y<<'\n';
+      }
+    })) {cerr<<"Error in export file"<<endl; throw(1);}
+  }
+  void VirtualMesh::ExportCell1D(const string path, unsigned int threads) const{
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    if(!ParallelWrite(path, "Id Marker punto1 punto2\n", NumberEdges(), threads, [this](TextWriter &out, unsigned int begin, unsigned int end){
+      for(unsigned int i=begin; i<end; i++){
+        Edge e = GetEdge(i);
+        out<<e.id<<' '<<EdgeMarker(i)<<' '<<e.p1.id<<' '<<e.p2.id<<'\n';
+      }
+    })) {cerr<<"Error in export file"<<endl; throw(1);}
+  }
+  void VirtualMesh::ExportCell2D(const string path, unsigned int threads) const{
+      //ogni blocco scorre i suoi triangoli con un iteratore che parte dal primo
+    if(threads==0) threads = max(1u, thread::hardware_concurrency());
+    if(!ParallelWrite(path, "Id punto1 punto2 punto3 lato1 lato2 lato3\n", nTriangles, threads, [this](TextWriter &out, unsigned int begin, unsigned int end){
+      TriangleIterator it(this, begin>>k, begin & ((1u<<k)-1));
+      for(unsigned int i=begin; i<end; i++, ++it){
+        const Cell &c = *it;
+        out<<c.id<<' '<<c.points[0].id<<' '<<c.points[1].id<<' '<<c.points[2].id<<' '<<c.edges[0]<<' '<<c.edges[1]<<' '<<c.edges[2]<<'\n';
+      }
+    })) {cerr<<"Error in export file"<<endl; throw(1);}
+  }
+  void VirtualMesh::ExportVTK(const string path) const{
+      //stesse sezioni di TriangularMesh::ExportVTK (punti e lati), scritte senza costruire la mesh
+    TextWriter out(path);
+    if(out.Fail()){cerr<<"Error in export VTK file"<<endl; throw(1);}
+    out<<"# vtk DataFile Version 3.0\nvtk file_k"<<k<<"\nASCII\nDATASET POLYDATA\n\n";
+    out<<"POINTS "<<NumberPoints()<<" double\n";
+    for(const Point p : Points())
+      out<<p.x<<' '<<p.y<<' '<<0.0<<'\n';
+    out<<"\nLINES "<<NumberEdges()<<' '<<uint64_t(NumberEdges())*3<<'\n';
+    for(const Edge e : Edges())
+      out<<2u<<' '<<e.p1.id<<' '<<e.p2.id<<'\n';
+    out.Close();
+    if(out.Fail()){cerr<<"Error in export VTK file"<<endl; throw(1);}
+  }
+}
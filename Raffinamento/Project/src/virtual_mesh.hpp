@@ -0,0 +1,112 @@
+#ifndef __VIRTUAL_MESH_H
+#define __VIRTUAL_MESH_H
+
+#include <iostream>
+#include "mesh_classes.hpp"
+
+using namespace std;
+
+namespace ProjectLibrary
+{
+    //mesh ottenuta con k livelli di bisezione uniforme (newest vertex) di una TriangularMesh, rappresentata in modo implicito.
+    //k deve essere pari: in due livelli ogni lato di ogni triangolo viene diviso una volta nel suo punto medio, quindi dopo k
+    //livelli ogni lato di partenza è diviso in n = 2^(k/2) segmenti uguali qualunque sia il lato di raffinamento dei vicini
+    //e la mesh è conforme (con k dispari due vicini possono dividere il lato comune in modo diverso).
+    //triangoli: id = id_padre*2^k + percorso, i bit del percorso (dal più significativo) scelgono il figlio ad ogni livello
+    //(0: lato di points[0], 1: lato di points[1]). i vertici sono i nodi del reticolo di passo 1/n in coordinate
+    //baricentriche di ogni triangolo di partenza, numerati senza memoria: i punti della mesh, poi gli n-1 punti interni di ogni
+    //lato (dall'estremo p1), poi i punti interni di ogni triangolo. i lati sono numerati dal loro punto medio, nello stesso
+    //modo: gli n segmenti di ogni lato di partenza, poi i 3n(n-1)/2 lati interni di ogni triangolo
+  class VirtualMesh
+  {
+    public:
+      struct Cell
+      {
+        unsigned int id;
+        array<Point,3> points;  //points[0],points[1]: lato di raffinamento ; points[2]: vertice opposto
+        array<unsigned int,3> edges;  //edges[i]: id del lato da points[i] a points[(i+1)%3]
+      };
+      typedef array<unsigned int,2> Node;  //nodo del reticolo di passo 1/(2n): pesi di points[0] e points[1] del padre
+      typedef array<Node,3> Lattice;
+
+      class TriangleIterator
+      {
+        public:
+          TriangleIterator(const VirtualMesh *mesh, unsigned int parent, unsigned int path=0);
+          const Cell& operator*() const {return cell;}
+          const Cell* operator->() const {return &cell;}
+          TriangleIterator& operator++();
+          bool operator!=(const TriangleIterator &it) const {return parent!=it.parent || path!=it.path;}
+        private:
+          const VirtualMesh *mesh;
+          unsigned int parent;
+          unsigned int path=0;
+          vector<Lattice> stack;  //stack[l] = antenato di livello l
+          Cell cell;
+          void Descend(unsigned int from);
+      };
+
+      template<typename T, T (VirtualMesh::*Get)(unsigned int) const>
+      class IdIterator
+      {
+          //scorre gli id in ordine calcolando ogni elemento al volo
+        public:
+          IdIterator(const VirtualMesh *mesh, unsigned int id): mesh(mesh), id(id) {}
+          T operator*() const {return (mesh->*Get)(id);}
+          IdIterator& operator++(){id++; return *this;}
+          bool operator!=(const IdIterator &it) const {return id!=it.id;}
+        private:
+          const VirtualMesh *mesh;
+          unsigned int id;
+      };
+
+      template<typename It>
+      struct Range
+      {
+        It first, last;
+        It begin() const {return first;}
+        It end() const {return last;}
+      };
+
+      VirtualMesh(const TriangularMesh &M, unsigned int k);
+      unsigned int NumberTriangles() const {return nTriangles;}
+      unsigned int NumberPoints() const {return nPointsBase + nEdgesBase*(n-1) + nBase*inner_points;}
+      unsigned int NumberEdges() const {return nEdgesBase*n + nBase*inner_edges;}
+      Cell GetTriangle(unsigned int id) const;  //O(k)
+      Point GetPoint(unsigned int id) const;    //O(log n)
+      Edge GetEdge(unsigned int id) const;      //O(k)
+      unsigned int PointMarker(unsigned int id) const;
+      unsigned int EdgeMarker(unsigned int id) const;
+
+      typedef IdIterator<Point, &VirtualMesh::GetPoint> PointIterator;
+      typedef IdIterator<Edge, &VirtualMesh::GetEdge> EdgeIterator;
+      TriangleIterator begin() const {return TriangleIterator(this, 0);}
+      TriangleIterator end() const {return TriangleIterator(this, nBase);}
+      Range<PointIterator> Points() const {return {PointIterator(this, 0), PointIterator(this, NumberPoints())};}
+      Range<EdgeIterator> Edges() const {return {EdgeIterator(this, 0), EdgeIterator(this, NumberEdges())};}
+
+        //stesse intestazioni di TriangularMesh::ExportMesh, righe formattate in parallelo (threads = 0: tutti i core)
+      void ExportCell0D(const string path, unsigned int threads=0) const;
+      void ExportCell1D(const string path, unsigned int threads=0) const;
+      void ExportCell2D(const string path, unsigned int threads=0) const;
+      void ExportVTK(const string path) const;
+
+    private:
+      const TriangularMesh &mesh;
+      unsigned int k;
+      unsigned int n;  //segmenti per lato di partenza
+      unsigned int nBase, nPointsBase, nEdgesBase;
+      unsigned int nTriangles;
+      unsigned int inner_points, inner_edges;  //per triangolo di partenza
+      Lattice Root() const;
+      static Lattice Child(const Lattice &T, unsigned int bit);
+      unsigned int OnEdge(unsigned int parent, const array<unsigned int,3> &w, unsigned int &position) const;
+      Point EdgePoint(unsigned int id_edge, unsigned int position) const;
+      Point InnerPoint(unsigned int parent, unsigned int a, unsigned int b) const;
+      Point NodePoint(unsigned int parent, const Node &v) const;
+      unsigned int NodeEdge(unsigned int parent, const Node &v1, const Node &v2) const;
+      Cell MakeCell(unsigned int id, const Lattice &T) const;
+  };
+}
+
+#endif // __VIRTUAL_MESH_H
@@ -3,10 +3,16 @@
 
 #include <gtest/gtest.h>
 #include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <clocale>
 #include "Eigen/Eigen"
 
 #include "mesh_classes.hpp"
 #include "sorting.hpp"
+#include "virtual_mesh.hpp"
+#include "mesh_io.hpp"
 
 using namespace testing;
 using namespace std;
@@ -103,7 +109,7 @@ TEST(TestTriangle, TestMaxEdge)
 TEST(TestTriangle, TestOrderEdges)
 {
   Edge edge1(Point(0,0,0),Point(1,0,1),0), edge2(Point(2,1,2),Point(1,0,1),1), edge3(Point(2,1,2),Point(0,0,0),2);
-  EXPECT_EQ(Triangle({edge1,edge2,edge3},0).edges, vector<Edge>({edge3,edge2,edge1}));
+  EXPECT_EQ(Triangle({edge1,edge2,edge3},0).edges, (array<Edge,3>({edge3,edge2,edge1})));
 }
 TEST(TestTriangle, TestOrderPoints)
 {
@@ -178,15 +184,1082 @@ TEST(TestTriangle, TestPointsToEdgeFalse)
   Edge edge1(Point(0,0,0),Point(1,1,1),0), edge2(Point(2,2,2),Point(1,1,1),1), edge3(Point(2,2,2),Point(0,0,0),2);
   Triangle T({edge1,edge2,edge3},0);
   EXPECT_EQ(T.PointsToEdge(Point(1,1,1),Point(5,5,5)).id, UINT_MAX);
+}
+TEST(TestTriangle, TestNotSorted)
+{
+    //senza ordinamento edges[0] resta il lato di raffinamento
+  Edge edge1(Point(0,0,0),Point(1,0,1),0), edge2(Point(2,1,2),Point(1,0,1),1), edge3(Point(2,1,2),Point(0,0,0),2);
+  Triangle T({edge1,edge2,edge3},0,false);
+  EXPECT_EQ(T.MaxEdge(), edge1);
+  EXPECT_EQ(T.Opposite(edge1), Point(2,1,2));
 }
     //TEST MESH
+TEST(TestMesh, TestRefiningNewest)
+{
+  for(string unif : {"non-uniform","uniform"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    double area = M.AvgArea()*M.NumberTriangles();
+    M.Refining(0.4,"newest",unif);
+    EXPECT_TRUE(M.Conforming());
+    EXPECT_NEAR(M.AvgArea()*M.NumberTriangles(), area, 1e-12);
+  }
+}
+TEST(TestMesh, TestNewestTies)
+{
+    //triangoli con i due lati più lunghi uguali: la prima divisione deve usare il lato di raffinamento
+    //scelto da LabelNewest (a parità di lunghezza quello con id maggiore), non l'ordine dell'importazione
+  for(string unif : {"non-uniform","uniform"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    unsigned int nT = M.NumberTriangles(), ties = 0;
+    vector<unsigned int> label(nT), imported(nT);
+    for(unsigned int i=0; i<nT; i++){
+      Triangle T = M.FindTriangle(i);
+      unsigned int k=0;
+      for(unsigned int j=1; j<3; j++)
+        if(T.edges[j]>T.edges[k] || (!(T.edges[k]>T.edges[j]) && T.edges[j].id>T.edges[k].id)) k=j;
+      label[i] = T.edges[k].id;
+      imported[i] = T.edges[0].id;
+    }
+    M.RecordTree();
+    M.Refining(1.0,"newest",unif);
+    EXPECT_TRUE(M.Conforming());
+    RefinementTree &tree = M.Tree();
+    for(unsigned int r=0; r<nT; r++){
+      if(tree.child[r]==UINT_MAX) continue;  //uniform divide i più grandi, anche tra i figli
+      EXPECT_EQ(tree.edge[r], label[r]);
+      if(label[r]!=imported[r]) ties++;
+    }
+    EXPECT_GT(ties, 0u);
+  }
+}
+TEST(TestMesh, TestRefiningConforming)
+{
+  for(string level : {"base","advanced"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+    M.Refining(0.6,level,"uniform");
+    EXPECT_TRUE(M.Conforming());
+  }
+}
+TEST(TestMesh, TestResumeRefining)
+{
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+    double area = 0;
+    for(unsigned int i=0; i<M.NumberTriangles(); i++) area += M.FindTriangle(i).area;
+    EXPECT_ANY_THROW(M.ResumeRefining(0.3));
+    M.Refining(0.2,level,"uniform");
+    unsigned int nT = M.NumberTriangles();
+    M.ResumeRefining(0.3);
+    EXPECT_GT(M.NumberTriangles(), nT);
+    EXPECT_TRUE(M.Conforming());
+    double new_area = 0;
+    for(unsigned int i=0; i<M.NumberTriangles(); i++) new_area += M.FindTriangle(i).area;
+    EXPECT_NEAR(new_area, area, 1e-9);
+  }
+}
+TEST(TestMesh, TestClone)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+  TriangularMesh C = M.Clone();
+  C.Refining(0.4,"advanced","uniform");
+  TriangularMesh R("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+  R.Refining(0.4,"advanced","uniform");
+  EXPECT_EQ(C.NumberTriangles(), R.NumberTriangles());
+  for(unsigned int i=0; i<R.NumberTriangles(); i++)
+    EXPECT_EQ(C.FindTriangle(i).edges, R.FindTriangle(i).edges);
+  EXPECT_GT(C.NumberTriangles(), M.NumberTriangles());
+  EXPECT_TRUE(M.Conforming());
+}
+TEST(TestMesh, TestIndicator)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+  unsigned int n = M.NumberTriangles();
+  vector<double> values(n, 0);
+  values[n-1] = 1;
+  double area = M.FindTriangle(n-1).area;
+  M.Refining(1.0/n,"base","non-uniform",Indicator::Values(values));
+  EXPECT_LT(M.FindTriangle(n-1).area, area);
+  EXPECT_TRUE(M.Conforming());
+
+  auto f = [](double x, double y){return -(x-0.3)*(x-0.3)-(y-0.7)*(y-0.7);};
+  TriangularMesh A("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2), B = A.Clone();
+  Indicator parallel = Indicator::Pointwise(f, 4);
+  parallel.block = 8;
+  A.Refining(0.3,"advanced","uniform",Indicator::Pointwise(f));
+  B.Refining(0.3,"advanced","uniform",parallel);
+  EXPECT_EQ(A.NumberTriangles(), B.NumberTriangles());
+  for(unsigned int i=0; i<A.NumberTriangles(); i++)
+    EXPECT_EQ(A.FindTriangle(i).edges, B.FindTriangle(i).edges);
+  EXPECT_TRUE(B.Conforming());
+}
+TEST(TestMesh, TestRefiningRegion)
+{
+  vector<Region> regions = {Region::Box(0.2,0.2,0.4,0.3), Region::Circle(0.7,0.6,0.1),
+                            Region::Polyline({Point(0.1,0.9,0), Point(0.5,0.5,1), Point(0.9,0.6,2)}),
+                            Region::Polygon({Point(0.6,0.1,0), Point(0.9,0.2,1), Point(0.7,0.4,2)})};
+  for(Region &region : regions)
+    for(string level : {"base","advanced","newest"}){
+      TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+      double area = 0;
+      for(unsigned int i=0; i<M.NumberTriangles(); i++) area += M.FindTriangle(i).area;
+      EXPECT_GT(M.RefiningRegion(region, 1e-3, level), 0u);
+      EXPECT_TRUE(M.Conforming());
+      double new_area = 0;
+      for(unsigned int i=0; i<M.NumberTriangles(); i++){
+        Triangle T = M.FindTriangle(i);
+        new_area += T.area;
+        if(region.Intersects(T.points)){EXPECT_LE(T.area, 1e-3);}
+      }
+      EXPECT_NEAR(new_area, area, 1e-9);
+    }
+    //riquadri molto più grandi della griglia (celle oltre UINT_MAX): gli indici restano nei limiti
+  for(Region region : {Region::Box(0.5,0.5,1e12,1e12), Region::Box(-1e12,-1e12,1e12,1e12)}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+    unsigned int nT = M.NumberTriangles();
+    EXPECT_EQ(M.RefiningRegion(region, 1e300, "base"), 0u);
+    EXPECT_GT(M.RefiningRegion(region, M.AvgArea(), "base"), 0u);
+    EXPECT_GT(M.NumberTriangles(), nT);
+    EXPECT_TRUE(M.Conforming());
+  }
+  EXPECT_FALSE(Region::Circle(0.5,0.5,0.1).Intersects({Point(0,0,0), Point(0.2,0,1), Point(0,0.2,2)}));
+  EXPECT_TRUE(Region::Polyline({Point(-1,0.05,0), Point(1,0.05,1)}).Intersects({Point(0,0,0), Point(0.2,0,1), Point(0,0.2,2)}));
+}
+TEST(TestMesh, TestRefiningDensity)
+{
+  vector<double> x, y;
+  for(unsigned int i=0; i<2000; i++){   //campioni concentrati vicino a (0.5,0.5)
+    double r = 0.3*(i%100)/100.0, a = 0.7*i;
+    x.push_back(0.5+r*r*cos(a));
+    y.push_back(0.5+r*r*sin(a));
+  }
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+    EXPECT_GT(M.RefiningDensity(x, y, 20, level), 0u);
+    EXPECT_TRUE(M.Conforming());
+    vector<unsigned int> density = M.Density();
+    unsigned int total = 0;
+    for(unsigned int d : density){
+      EXPECT_LE(d, 20u);
+      total += d;
+    }
+    EXPECT_EQ(total, x.size());
+  }
+}
+TEST(TestMesh, TestMetric)
+{
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+    M.SetMetric([](double, double){return array<double,3>({1, 0, 400});});  //lati verticali 20 volte più lunghi
+    M.Refining(0.5,level,"uniform");
+    EXPECT_TRUE(M.Conforming());
+    double max_dy = 0, max_dx = 0;
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){
+      Triangle T = M.FindTriangle(i);
+      if(level!="newest"){
+        for(Edge &E : T.edges) EXPECT_LE(M.MetricLength(E.id), M.MetricLength(T.MaxEdge().id)*(1+1e-12));
+      }
+      for(Edge &E : T.edges){
+        max_dx = max(max_dx, abs(E.p1.x-E.p2.x));
+        max_dy = max(max_dy, abs(E.p1.y-E.p2.y));
+      }
+    }
+    EXPECT_LT(max_dy, max_dx);
+      //senza metrica il lato da dividere torna il più lungo
+    M.ClearMetric();
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){
+      Triangle T = M.FindTriangle(i);
+      for(Edge &E : T.edges) EXPECT_LE(E.length, T.MaxEdge().length*(1+1e-12));
+    }
+    M.Refining(0.3,"base","uniform");
+    EXPECT_TRUE(M.Conforming());
+  }
+    //una metrica non valida a metà dei punti non deve lasciare una metrica parziale
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2), E = M.Clone();
+  unsigned int calls = 0;
+  EXPECT_ANY_THROW(M.SetMetric([&](double, double){return array<double,3>({(++calls<50)? 1.0 : -1.0, 0, 1});}));
+  M.Refining(0.3,"base","uniform");
+  E.Refining(0.3,"base","uniform");
+  EXPECT_EQ(M.NumberTriangles(), E.NumberTriangles());
+}
+TEST(TestMesh, TestMarkers)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+  M.Refining(0.6,"advanced","uniform");
+  for(unsigned int i=0; i<M.NumberPoints(); i++){   //marker 5: y=0, 6: x=1, 7: y=1, 8: x=0
+    Point p = M.FindPoint(i);
+    if(M.PointMarker(i)==5){EXPECT_NEAR(p.y, 0, 1e-12);}
+    if(M.PointMarker(i)==6){EXPECT_NEAR(p.x, 1, 1e-12);}
+  }
+  for(unsigned int marker=5; marker<=8; marker++){
+    double length = 0;
+    for(unsigned int e : M.MarkedEdges(marker)){
+      EXPECT_EQ(M.EdgeMarker(e), marker);
+      length += M.FindEdge(e).length;
+    }
+    EXPECT_NEAR(length, 1, 1e-12);
+  }
+
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh B("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    unsigned int n = B.NumberTriangles();
+    unsigned int divided = B.RefiningBoundary({5}, 2, level);
+    EXPECT_GT(divided, 0u);
+    EXPECT_GT(B.NumberTriangles(), n);
+    EXPECT_TRUE(B.Conforming());
+    EXPECT_GT(B.MarkedEdges(5).size(), 8u);
+  }
+}
+TEST(TestMesh, TestFields)
+{
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    vector<double> linear, length, area, ones;
+    for(unsigned int i=0; i<M.NumberPoints(); i++) linear.push_back(2*M.FindPoint(i).x+3*M.FindPoint(i).y);
+    for(unsigned int i=0; i<M.NumberEdges(); i++) length.push_back(M.FindEdge(i).length);
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){area.push_back(M.FindTriangle(i).area); ones.push_back(1);}
+    M.AddField("point","linear",linear);
+    M.AddField("edge","length",length,true);
+    M.AddField("edge","constant",vector<double>(M.NumberEdges(), 2.5));
+    M.AddField("triangle","area",area,true);
+    M.AddField("triangle","ones",ones);
+    M.RecordTree();
+    M.Refining(0.5,level,"uniform");
+    for(unsigned int i=0; i<M.NumberPoints(); i++)
+      EXPECT_NEAR(M.GetField("point","linear")[i], 2*M.FindPoint(i).x+3*M.FindPoint(i).y, 1e-12);
+    for(unsigned int i=0; i<M.NumberEdges(); i++){   //i lati aggiunti partono da 0 solo nei campi estensivi
+      double l = M.GetField("edge","length")[i];
+      if(l!=0){EXPECT_NEAR(l, M.FindEdge(i).length, 1e-12);}
+      EXPECT_NEAR(M.GetField("edge","constant")[i], 2.5, 1e-12);
+    }
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){
+      EXPECT_NEAR(M.GetField("triangle","area")[i], M.FindTriangle(i).area, 1e-12);
+      EXPECT_EQ(M.GetField("triangle","ones")[i], 1);
+    }
+    while(M.Coarsening([](const Triangle &){return true;})>0);
+    for(unsigned int i=0; i<M.NumberTriangles(); i++)
+      EXPECT_NEAR(M.GetField("triangle","area")[i], area[i], 1e-12);
+    for(unsigned int i=0; i<M.NumberEdges(); i++)
+      EXPECT_NEAR(M.GetField("edge","length")[i], length[i], 1e-12);
+  }
+}
+TEST(TestMesh, TestBudget)
+{
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1), F = M.Clone();
+    F.Refining(0.8,level,"uniform");
+    EXPECT_EQ(F.Stopped(), "");
+
+    atomic<bool> cancel(false);
+    unsigned int calls = 0;
+    TriangularMesh C = M.Clone();
+    C.Options().progress_every = 10;
+    C.Options().progress = [&](unsigned int splits, unsigned int){calls++; if(splits>=30) cancel = true;};
+    C.Options().cancel = &cancel;
+    C.Refining(0.8,level,"uniform");
+    EXPECT_EQ(C.Stopped(), "cancel");
+    EXPECT_GE(calls, 3u);
+    EXPECT_LT(C.NumberTriangles(), F.NumberTriangles());
+    EXPECT_TRUE(C.Conforming());
+
+    TriangularMesh B = M.Clone();
+    B.Options().memory_budget = B.MemoryUsage();
+    B.Refining(0.8,level,"uniform");
+    EXPECT_EQ(B.Stopped(), "memory");
+    EXPECT_TRUE(B.Conforming());
+    B.Options().memory_budget = 0;
+    B.Options().time_budget = 1e-9;
+    B.ResumeRefining(0.5);
+    EXPECT_EQ(B.Stopped(), "time");
+    EXPECT_TRUE(B.Conforming());
+  }
+}
+TEST(TestMesh, TestMemoryUsage)
+{
+    //campi, albero, journal e campioni crescono con le divisioni e vanno contati nel budget
+  vector<double> x, y;
+  for(unsigned int i=0; i<1000; i++){x.push_back(0.5+0.4*cos(0.3*i)*(i%40)/40.0); y.push_back(0.5+0.4*sin(0.3*i)*(i%40)/40.0);}
+  for(string level : {"base","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1), E = M.Clone();
+    E.AddField("triangle", "f", vector<double>(E.NumberTriangles(), 1.0));
+    E.RecordTree();
+    E.RecordJournal();
+    M.Refining(0.5,level,"uniform");
+    E.Refining(0.5,level,"uniform");
+    ASSERT_EQ(E.NumberTriangles(), M.NumberTriangles());
+    size_t extra = E.NumberTriangles()*(sizeof(double)+sizeof(unsigned int)) + E.Tree().Size()*sizeof(unsigned int);
+    EXPECT_GE(E.MemoryUsage(), M.MemoryUsage()+extra);
+
+    TriangularMesh D = M.Clone(), P = M.Clone();
+    D.RefiningDensity(x, y, 10, level);
+    P.Refining(0.0,level,"uniform");
+    EXPECT_GE(D.MemoryUsage(), P.MemoryUsage()+2*x.size()*sizeof(double)+x.size()*sizeof(unsigned int));
+
+      //un budget sufficiente per la sola geometria finale non basta se ci sono i campi
+    TriangularMesh B("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    B.AddField("point", "p", vector<double>(B.NumberPoints(), 0.0));
+    B.AddField("edge", "e", vector<double>(B.NumberEdges(), 0.0));
+    B.Options().memory_budget = M.MemoryUsage();
+    B.Refining(0.5,level,"uniform");
+    EXPECT_EQ(B.Stopped(), "memory");
+    EXPECT_LT(B.NumberTriangles(), M.NumberTriangles());
+    EXPECT_TRUE(B.Conforming());
+  }
+}
+TEST(TestMesh, TestRefiningParallel)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",3);   //due copie disgiunte del test 1
+  unsigned int nComponents;
+  vector<unsigned int> component = M.Components(nComponents);
+  EXPECT_EQ(nComponents, 2u);
+  EXPECT_EQ(component[0], 0u);
+  EXPECT_EQ(component[M.NumberTriangles()-1], 1u);
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh P = M.Clone(), S = M.Clone();
+    P.RefiningParallel(0.4,level,"non-uniform",2);
+    S.Refining(0.4,level,"non-uniform");
+    EXPECT_TRUE(P.Conforming());
+    EXPECT_EQ(P.NumberPoints(), S.NumberPoints());
+    EXPECT_EQ(P.NumberEdges(), S.NumberEdges());
+    ASSERT_EQ(P.NumberTriangles(), S.NumberTriangles());
+    vector<double> area_p, area_s;
+    for(unsigned int i=0; i<P.NumberTriangles(); i++){
+      area_p.push_back(P.FindTriangle(i).area);
+      area_s.push_back(S.FindTriangle(i).area);
+    }
+    sort(area_p.begin(), area_p.end());
+    sort(area_s.begin(), area_s.end());
+    for(unsigned int i=0; i<area_p.size(); i++) EXPECT_NEAR(area_p[i], area_s[i], 1e-14);
+
+    double length = 0;
+    for(unsigned int e : P.MarkedEdges(5)) length += P.FindEdge(e).length;
+    EXPECT_NEAR(length, 2, 1e-12);
+  }
+    //il budget di memoria vale per la mesh intera, non per ogni componente
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh P = M.Clone(), S = M.Clone();
+    size_t budget = M.MemoryUsage()*3/2;
+    P.Options().memory_budget = S.Options().memory_budget = budget;
+    P.RefiningParallel(1.0,level,"non-uniform",2);
+    S.Refining(1.0,level,"non-uniform");
+    EXPECT_EQ(P.Stopped(), "memory");
+    EXPECT_EQ(S.Stopped(), "memory");
+    EXPECT_TRUE(P.Conforming());
+    EXPECT_LT(P.MemoryUsage(), budget*5/4);
+    EXPECT_LT(S.MemoryUsage(), budget*5/4);
+  }
+  TriangularMesh U = M.Clone();
+  EXPECT_ANY_THROW(U.RefiningParallel(0.5,"base","uniform"));
+  U.Options().progress = [](unsigned int, unsigned int){};
+  EXPECT_ANY_THROW(U.RefiningParallel(0.5,"base","non-uniform"));
+  EXPECT_EQ(U.NumberTriangles(), M.NumberTriangles());
+}
+TEST(TestImport, TestParse)
+{
+  string line = "12 3\t-1.2500000000000000e-01 0.1 3.3333333333333331e-01 abc";
+  const char *p = line.c_str(), *end = p+line.size();
+  unsigned int id, marker;
+  double x, y, z;
+  p = ParseUnsigned(p, end, id);
+  p = ParseUnsigned(p, end, marker);
+  p = ParseDouble(p, end, x);
+  p = ParseDouble(p, end, y);
+  p = ParseDouble(p, end, z);
+  ASSERT_NE(p, nullptr);
+  EXPECT_EQ(id, 12u);
+  EXPECT_EQ(marker, 3u);
+  EXPECT_EQ(x, -0.125);
+  EXPECT_EQ(y, 0.1);
+  EXPECT_EQ(z, strtod("3.3333333333333331e-01", nullptr));
+  EXPECT_EQ(ParseDouble(p, end, x), nullptr);
+  EXPECT_EQ(ParseUnsigned(p, end, id), nullptr);
+
+    //i numeri fuori dal percorso veloce non dipendono da LC_NUMERIC, anche oltre il buffer locale di 128 caratteri
+  string digits = "0."+string(200,'3')+"e0";
+  string previous = setlocale(LC_NUMERIC, nullptr);
+  for(const char *name : {"de_DE.UTF-8", "it_IT.UTF-8", "fr_FR.UTF-8", "C"})
+    if(setlocale(LC_NUMERIC, name)) break;
+  for(string number : {string("3.3333333333333331e-01"), digits}){
+    ASSERT_NE(ParseDouble(number.c_str(), number.c_str()+number.size(), z), nullptr);
+    EXPECT_EQ(z, 1.0/3);
+  }
+  setlocale(LC_NUMERIC, previous.c_str());
+}
+TEST(TestImport, TestParallel)
+{
+  string path = "./../Project/Dataset/parallel_import.csv";
+  ofstream file(path);
+  file<<"Id Marker X Y"<<endl;
+  for(unsigned int i=0; i<100000; i++) file<<i<<" "<<i%7<<" "<<setprecision(16)<<i/3.0<<" "<<-1.0/(i+1)<<endl;
+  file.close();
+  Table sequential, parallel;
+  ASSERT_TRUE(ReadTable(path, "uudd", 1, sequential));
+  ASSERT_TRUE(ReadTable(path, "uudd", 4, parallel));
+  remove(path.c_str());
+  EXPECT_EQ(sequential.rows, 100000u);
+  EXPECT_EQ(parallel.rows, sequential.rows);
+  EXPECT_EQ(parallel.u, sequential.u);
+  EXPECT_EQ(parallel.d, sequential.d);
+
+    //le righe vuote vengono saltate, una riga non valida (che sposterebbe gli id successivi) è un errore
+  file.open(path);
+  file<<"Id Marker X Y\n0 1 0.5 0.5\n\n  \r\n1 0 1 2\n";
+  file.close();
+  ASSERT_TRUE(ReadTable(path, "uudd", 1, sequential));
+  EXPECT_EQ(sequential.rows, 2u);
+  file.open(path);
+  file<<"Id Marker X Y\n0 1 0.5 0.5\n1 0 x 2\n2 0 1 2\n";
+  file.close();
+  EXPECT_ANY_THROW(ReadTable(path, "uudd", 1, sequential));
+
+    //righe vuote sparse in più blocchi (>1MB ciascuno): le righe lette sono avvicinate senza buchi
+  file.open(path);
+  file<<"Id Marker X Y"<<endl;
+  for(unsigned int i=0; i<100000; i++){
+    file<<i<<" "<<i%7<<" "<<setprecision(16)<<i/3.0<<" "<<-1.0/(i+1)<<endl;
+    if(i%1000==0) file<<endl;
+  }
+  file.close();
+  ASSERT_TRUE(ReadTable(path, "uudd", 4, sequential));
+  EXPECT_EQ(sequential.rows, parallel.rows);
+  EXPECT_EQ(sequential.u, parallel.u);
+  EXPECT_EQ(sequential.d, parallel.d);
+
+    //il numero di colonne non è limitato, un formato con lettere diverse da u e d è un errore
+  file.open(path);
+  file<<"header\n";
+  for(unsigned int k=0; k<20; k++) file<<k<<" ";
+  file<<"\n";
+  file.close();
+  ASSERT_TRUE(ReadTable(path, string(20,'u'), 1, sequential));
+  ASSERT_EQ(sequential.u.size(), 20u);
+  EXPECT_EQ(sequential.u[19], 19u);
+  EXPECT_ANY_THROW(ReadTable(path, "uux", 1, sequential));
+  EXPECT_ANY_THROW(ReadTable(path, "", 1, sequential));
+  remove(path.c_str());
+
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2,1), P("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2,4);
+  ASSERT_EQ(M.NumberTriangles(), P.NumberTriangles());
+  for(unsigned int i=0; i<M.NumberEdges(); i++) EXPECT_EQ(M.FindEdge(i).length, P.FindEdge(i).length);
+  for(unsigned int i=0; i<M.NumberTriangles(); i++){
+    EXPECT_EQ(M.FindTriangle(i).id, P.FindTriangle(i).id);
+    EXPECT_EQ(M.FindTriangle(i).area, P.FindTriangle(i).area);
+  }
+}
+TEST(TestImport, TestBinary)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+  M.Refining(0.3);
+  M.ExportBinary("./../Project/Dataset/Test2/binary_test.rmesh");
+  TriangularMesh B("binary_test.rmesh",2);
+  remove("./../Project/Dataset/Test2/binary_test.rmesh");
+  ASSERT_EQ(B.NumberPoints(), M.NumberPoints());
+  ASSERT_EQ(B.NumberEdges(), M.NumberEdges());
+  ASSERT_EQ(B.NumberTriangles(), M.NumberTriangles());
+  for(unsigned int i=0; i<M.NumberPoints(); i++) EXPECT_EQ(B.PointMarker(i), M.PointMarker(i));
+  for(unsigned int i=0; i<M.NumberEdges(); i++){
+    EXPECT_EQ(B.FindEdge(i).length, M.FindEdge(i).length);
+    EXPECT_EQ(B.EdgeMarker(i), M.EdgeMarker(i));
+  }
+  for(unsigned int i=0; i<M.NumberTriangles(); i++) EXPECT_EQ(B.FindTriangle(i).area, M.FindTriangle(i).area);
+  EXPECT_TRUE(B.Conforming());
+  M.Refining(0.5); B.Refining(0.5);
+  EXPECT_EQ(B.NumberTriangles(), M.NumberTriangles());
+  EXPECT_TRUE(B.Conforming());
+  EXPECT_ANY_THROW(TriangularMesh("Cell0Ds.csv",2));
+
+    //stessa mesh, stesso file: i byte di allineamento sono 0
+  string path = "./../Project/Dataset/Test2/binary_test.rmesh";
+  auto read = [&](){
+    ifstream file(path, ios::binary);
+    return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+  };
+  M.ExportBinary(path);
+  string first = read();
+  B.ExportBinary(path);
+  EXPECT_EQ(read(), first);
+  size_t points = sizeof(MeshHeader);
+  for(size_t i=2*sizeof(double)+sizeof(unsigned int); i<sizeof(Point); i++) EXPECT_EQ(first[points+i], 0);
+    //file danneggiati: conteggi oltre la dimensione del file, id fuori dagli array, righe di adiacenza con più di 2 triangoli
+  auto corrupt = [&](size_t offset, uint32_t value){
+    string content = first;
+    memcpy(&content[offset], &value, sizeof(value));
+    ofstream file(path, ios::binary);
+    file<<content;
+    file.close();
+    EXPECT_ANY_THROW(TriangularMesh("binary_test.rmesh",2));
+  };
+  corrupt(offsetof(MeshHeader, counts)+2*sizeof(uint32_t), UINT32_MAX/2);
+  size_t triangles = points + Align8(M.NumberPoints()*sizeof(Point)) + Align8(M.NumberEdges()*sizeof(Edge));
+  corrupt(triangles + offsetof(Triangle, edges) + offsetof(Edge, id), M.NumberEdges());
+  corrupt(first.size() - Align8(M.NumberEdges()*sizeof(AdjacentRow)) + offsetof(AdjacentRow, n), 3);
+  remove(path.c_str());
+}
+TEST(TestImport, TestCache)
+{
+  string cache = "./../Project/Dataset/Test2/.Cell0Ds.csv.Cell1Ds.csv.Cell2Ds.csv.cache";
+  remove(cache.c_str());
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2,0,true);
+  CacheHeader header;
+  ifstream file(cache, ios::binary);
+  ASSERT_FALSE(file.fail());
+  file.read((char*)&header, sizeof(header));
+  file.close();
+  FileKey key;
+  ASSERT_TRUE(StatFile("./../Project/Dataset/Test2/Cell0Ds.csv", key));
+  EXPECT_EQ(header.keys[0].size, key.size);
+  EXPECT_EQ(header.keys[0].hash, HashFile("./../Project/Dataset/Test2/Cell0Ds.csv"));
+
+  TriangularMesh C("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2,0,true);
+  ASSERT_EQ(C.NumberTriangles(), M.NumberTriangles());
+  for(unsigned int i=0; i<M.NumberTriangles(); i++) EXPECT_EQ(C.FindTriangle(i).area, M.FindTriangle(i).area);
+  M.Refining(0.4); C.Refining(0.4);
+  EXPECT_EQ(C.NumberTriangles(), M.NumberTriangles());
+  EXPECT_TRUE(C.Conforming());
+
+    //chiave non più valida: la cache viene ricostruita
+  header.keys[1].size++;
+  fstream stale(cache, ios::binary | ios::in | ios::out);
+  stale.write((char*)&header, sizeof(header));
+  stale.close();
+  TriangularMesh R("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2,0,true);
+  EXPECT_EQ(R.NumberEdges(), TriangularMesh("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2).NumberEdges());
+  ifstream rebuilt(cache, ios::binary);
+  rebuilt.read((char*)&header, sizeof(header));
+  rebuilt.close();
+  ASSERT_TRUE(StatFile("./../Project/Dataset/Test2/Cell1Ds.csv", key));
+  EXPECT_EQ(header.keys[1].size, key.size);
+
+    //chiavi valide ma contenuto danneggiato (id di un triangolo): la mesh viene importata dai file e la cache riscritta
+  ifstream valid(cache, ios::binary);
+  string content((istreambuf_iterator<char>(valid)), istreambuf_iterator<char>());
+  valid.close();
+  MeshHeader mesh;
+  memcpy(&mesh, &content[sizeof(CacheHeader)], sizeof(mesh));
+  size_t triangle = sizeof(CacheHeader)+sizeof(mesh)+Align8(mesh.counts[0]*sizeof(Point))+Align8(mesh.counts[1]*sizeof(Edge));
+  unsigned int wrong_id = 7;
+  memcpy(&content[triangle+offsetof(Triangle, id)], &wrong_id, sizeof(wrong_id));
+  ofstream damaged(cache, ios::binary);
+  damaged<<content;
+  damaged.close();
+  TriangularMesh D("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2,0,true);
+  ASSERT_EQ(D.NumberTriangles(), R.NumberTriangles());
+  for(unsigned int i=0; i<D.NumberTriangles(); i++) EXPECT_EQ(D.FindTriangle(i).id, i);
+  D.Refining(0.4);
+  EXPECT_TRUE(D.Conforming());
+  TriangularMesh F("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2,0,true);
+  EXPECT_EQ(F.FindTriangle(0).id, 0u);
+  remove(cache.c_str());
+}
+TEST(TestExport, TestVTKBinary)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+  M.RecordTree();
+  M.Refining(0.3,"base","uniform");
+  M.ExportVTKBinary();
+  string path = "./../Project/Dataset/Test2Completed/base/newBinaryVTKuniform_t30.vtk";
+  ifstream file(path, ios::binary);
+  ASSERT_FALSE(file.fail());
+  string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+  file.close();
+  remove(path.c_str());
+  auto big_endian = [&](size_t offset, unsigned int bytes){
+    uint64_t v = 0;
+    for(unsigned int i=0; i<bytes; i++) v = (v<<8) | (unsigned char)content[offset+i];
+    return v;
+  };
+  auto as_double = [&](size_t offset){uint64_t v = big_endian(offset,8); double d; memcpy(&d, &v, 8); return d;};
+  string points = "POINTS "+to_string(M.NumberPoints())+" double\n";
+  size_t p = content.find(points);
+  ASSERT_NE(p, string::npos);
+  p += points.size();
+  EXPECT_EQ(as_double(p), M.FindPoint(0).x);
+  EXPECT_EQ(as_double(p+8), M.FindPoint(0).y);
+  EXPECT_EQ(as_double(p+24*(M.NumberPoints()-1)+8), M.FindPoint(M.NumberPoints()-1).y);
+  string polygons = "POLYGONS "+to_string(M.NumberTriangles())+" "+to_string(4*M.NumberTriangles())+"\n";
+  p = content.find(polygons, p+24*M.NumberPoints());
+  ASSERT_NE(p, string::npos);
+  p += polygons.size();
+  EXPECT_EQ(big_endian(p,4), 3u);
+  EXPECT_EQ(big_endian(p+4,4), M.FindTriangle(0).points[0].id);
+  string area = "CELL_DATA "+to_string(M.NumberTriangles())+"\nSCALARS area double 1\nLOOKUP_TABLE default\n";
+  p = content.find(area, p+16*M.NumberTriangles());
+  ASSERT_NE(p, string::npos);
+  EXPECT_EQ(as_double(p+area.size()), M.FindTriangle(0).area);
+  EXPECT_NE(content.find("SCALARS level int 1"), string::npos);
+}
+TEST(TestExport, TestTextWriter)
+{
+  string path = "./../Project/Dataset/text_writer.csv";
+  vector<double> values = {0.0, -0.0, 1.0, 0.1, -0.125, 1.0/3, 123456.7, 1234567.0, 1e-5, 1.5e-7, 2.5e300, -4e-310};
+  ostringstream expected;
+  {
+    TextWriter out(path, 64);  //buffer piccolo per scriverlo più volte
+    out<<"Id x y\n";
+    expected<<"Id x y"<<endl;
+    for(unsigned int i=0; i<values.size(); i++){
+      out<<i<<' '<<-int(i)<<' '<<values[i]<<' '<<string("ok")<<'\n';
+      expected<<i<<" "<<-int(i)<<" "<<values[i]<<" "<<"ok"<<endl;
+    }
+    out.Precision(12);
+    expected<<setprecision(12);
+    out<<values[5]<<'\n'<<uint64_t(UINT64_MAX)<<'\n';
+    expected<<values[5]<<endl<<UINT64_MAX<<endl;
+    out.Close();
+    EXPECT_FALSE(out.Fail());
+  }
+  ifstream file(path);
+  string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+  file.close();
+  remove(path.c_str());
+  EXPECT_EQ(content, expected.str());
+}
+TEST(TestExport, TestParallelWrite)
+{
+  string path = "./../Project/Dataset/parallel_write.csv";
+  auto format = [](TextWriter &out, unsigned int begin, unsigned int end){
+    for(unsigned int i=begin; i<end; i++) out<<i<<' '<<i/7.0<<' '<<((i%3)? "a" : "bcd")<<'\n';
+  };
+  TextWriter sequential;
+  sequential<<"header\n";
+  format(sequential, 0, 10000);
+  for(unsigned int threads : {1u, 3u, 8u}){
+    ASSERT_TRUE(ParallelWrite(path, "header\n", 10000, threads, format, 37));
+    ifstream file(path, ios::binary);
+    string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
+    EXPECT_EQ(content, string(sequential.Data(), sequential.Size()));
+  }
+  ASSERT_TRUE(ParallelWrite(path, "", 0, 4, format));
+  ifstream empty(path, ios::binary);
+  EXPECT_EQ(empty.peek(), EOF);
+  empty.close();
+  remove(path.c_str());
+}
+TEST(TestExport, TestExportQueue)
+{
+  auto read = [](string path){
+    ifstream file(path, ios::binary);
+    string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
+    remove(path.c_str());
+    return content;
+  };
+  string path = "./../Project/Dataset/Test2Completed/";
+  vector<string> files = {"base/New1Duniform_t30.csv", "advanced/New1Duniform_t30.csv", "advanced/New2Dnon-uniform_t30.csv"};
+  vector<string> expected;
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2), A = M.Clone(), N = M.Clone();
+  M.Refining(0.3,"base","uniform"); A.Refining(0.3,"advanced","uniform"); N.Refining(0.3,"advanced","non-uniform");
+  M.ExportMesh({1}); A.ExportMesh({1}); N.ExportMesh({2});
+  for(string &f : files) expected.push_back(read(path+f));
+  {
+    ExportQueue queue(1);  //una mesh alla volta
+    queue.Push(move(M), {"cell1D"});
+    queue.Push(move(A), {"cell1D"});
+    queue.Push(move(N), {"cell2D"});
+    EXPECT_ANY_THROW(queue.Push(TriangularMesh(), {"pdf"}));
+    queue.Wait();
+    EXPECT_EQ(queue.Queued(), 0u);
+  }
+  for(unsigned int i=0; i<files.size(); i++) EXPECT_EQ(read(path+files[i]), expected[i]);
+    //un errore mai riportato da Push o Wait viene scritto dal distruttore (Test3Completed non esiste)
+  testing::internal::CaptureStderr();
+  {
+    ExportQueue queue;
+    TriangularMesh F("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",3);
+    F.Refining(0.1,"base","uniform");
+    queue.Push(move(F), {"cell0D"});
+  }
+  EXPECT_NE(testing::internal::GetCapturedStderr().find("was not reported"), string::npos);
+}
+TEST(TestExport, TestArchive)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+  M.Refining(0.6,"advanced","non-uniform");
+  for(bool xor_coordinates : {true, false}){
+    M.ExportArchive("./../Project/Dataset/Test2/archive_test.rarc", xor_coordinates);
+    TriangularMesh A("archive_test.rarc",2);
+    remove("./../Project/Dataset/Test2/archive_test.rarc");
+    ASSERT_EQ(A.NumberPoints(), M.NumberPoints());
+    ASSERT_EQ(A.NumberEdges(), M.NumberEdges());
+    ASSERT_EQ(A.NumberTriangles(), M.NumberTriangles());
+    for(unsigned int i=0; i<M.NumberPoints(); i++){
+      EXPECT_EQ(A.FindPoint(i).x, M.FindPoint(i).x);
+      EXPECT_EQ(A.FindPoint(i).y, M.FindPoint(i).y);
+      EXPECT_EQ(A.PointMarker(i), M.PointMarker(i));
+    }
+    for(unsigned int i=0; i<M.NumberEdges(); i++){
+      EXPECT_EQ(A.FindEdge(i).p1.id, M.FindEdge(i).p1.id);
+      EXPECT_EQ(A.FindEdge(i).p2.id, M.FindEdge(i).p2.id);
+      EXPECT_EQ(A.EdgeMarker(i), M.EdgeMarker(i));
+    }
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){
+      EXPECT_EQ(A.FindTriangle(i).id, M.FindTriangle(i).id);
+      EXPECT_EQ(A.FindTriangle(i).area, M.FindTriangle(i).area);
+      for(unsigned int j=0; j<3; j++) EXPECT_EQ(A.FindTriangle(i).points[j].id, M.FindTriangle(i).points[j].id);
+    }
+    EXPECT_TRUE(A.Conforming());
+  }
+
+  string path = "./../Project/Dataset/Test2/archive_test.rarc";
+  M.ExportArchive(path);
+  ifstream file(path, ios::binary);
+  string archive((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+  file.close();
+    //conteggio dei punti oltre 32 bit: 2^32+nPoints non deve essere letto come nPoints
+  ArchiveReader in(archive.data()+6, archive.data()+archive.size());
+  ASSERT_EQ(in.Varint(), uint64_t(M.NumberPoints()));
+  ArchiveWriter count;
+  count.Varint((uint64_t(1)<<32)+M.NumberPoints());
+  string wide = archive.substr(0, 6)+string(count.data.begin(), count.data.end())+archive.substr(in.Position()-archive.data());
+  ofstream corrupt(path, ios::binary);
+  corrupt<<wide;
+  corrupt.close();
+  EXPECT_ANY_THROW(TriangularMesh("archive_test.rarc",2));
+
+    //id del secondo lato spostato di 1e8 dalla sua posizione
+  ArchiveReader rows(archive.data()+4, archive.data()+archive.size());
+  rows.Varint();
+  bool xor_encode = rows.Varint() & 1;
+  uint64_t nP = rows.Varint();
+  rows.Varint(); rows.Varint();
+  uint64_t previous_x = 0, previous_y = 0;
+  for(uint64_t i=0; i<nP; i++){rows.Signed(); rows.Varint(); rows.Double(previous_x, xor_encode); rows.Double(previous_y, xor_encode);}
+  for(unsigned int k=0; k<4; k++) rows.Signed();
+  size_t id_begin = rows.Position()-archive.data();
+  ASSERT_EQ(rows.Signed(), 0);
+  ArchiveWriter id;
+  id.Signed(100000000);
+  string moved = archive.substr(0, id_begin)+string(id.data.begin(), id.data.end())+archive.substr(rows.Position()-archive.data());
+  ofstream corrupt_id(path, ios::binary);
+  corrupt_id<<moved;
+  corrupt_id.close();
+  EXPECT_ANY_THROW(TriangularMesh("archive_test.rarc",2));
+
+  archive.resize(archive.size()/2);
+  ofstream truncated(path, ios::binary);
+  truncated<<archive;
+  truncated.close();
+  EXPECT_ANY_THROW(TriangularMesh("archive_test.rarc",2));
+  remove(path.c_str());
+}
+TEST(TestExport, TestDelta)
+{
+  string path = "./../Project/Dataset/Test1/delta_test.rdlt";
+  for(string level : {"base","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    M.RecordTree();
+    vector<TriangularMesh> steps;
+    M.ExportDelta(path); steps.push_back(M.Clone());
+    M.Refining(0.3,level,"uniform");
+    M.ExportDelta(path); steps.push_back(M.Clone());
+    M.ResumeRefining(0.2);
+    M.ExportDelta(path); steps.push_back(M.Clone());
+    double avg = M.AvgArea();
+    M.Coarsening([avg](const Triangle &T){return T.area<avg;});
+    M.ExportDelta(path); steps.push_back(M.Clone());
+    M.ExportDelta(path); steps.push_back(M.Clone());  //nessuna modifica
+
+    ASSERT_EQ(TriangularMesh::DeltaSteps("delta_test.rdlt",1), steps.size());
+    for(unsigned int s=0; s<steps.size(); s++){
+      TriangularMesh &E = steps[s];
+      TriangularMesh D("delta_test.rdlt",1,s);
+      ASSERT_EQ(D.NumberPoints(), E.NumberPoints());
+      ASSERT_EQ(D.NumberEdges(), E.NumberEdges());
+      ASSERT_EQ(D.NumberTriangles(), E.NumberTriangles());
+      for(unsigned int i=0; i<E.NumberPoints(); i++){
+        EXPECT_EQ(D.FindPoint(i).x, E.FindPoint(i).x);
+        EXPECT_EQ(D.PointMarker(i), E.PointMarker(i));
+      }
+      for(unsigned int i=0; i<E.NumberEdges(); i++){
+        EXPECT_EQ(D.FindEdge(i).p1.id, E.FindEdge(i).p1.id);
+        EXPECT_EQ(D.FindEdge(i).p2.id, E.FindEdge(i).p2.id);
+        EXPECT_EQ(D.EdgeMarker(i), E.EdgeMarker(i));
+      }
+      for(unsigned int i=0; i<E.NumberTriangles(); i++)
+        for(unsigned int j=0; j<3; j++) EXPECT_EQ(D.FindTriangle(i).edges[j].id, E.FindTriangle(i).edges[j].id);
+      EXPECT_TRUE(D.Conforming());
+    }
+    EXPECT_EQ(TriangularMesh("delta_test.rdlt",1).NumberTriangles(), steps.back().NumberTriangles());
+    EXPECT_ANY_THROW(TriangularMesh("delta_test.rdlt",1,steps.size()));
+  }
+    //un passo senza modifiche occupa pochi byte
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+  M.ExportDelta(path);
+  ifstream first(path, ios::binary | ios::ate);
+  size_t size = first.tellg();
+  first.close();
+  M.ExportDelta(path);
+  ifstream second(path, ios::binary | ios::ate);
+  EXPECT_LE(size_t(second.tellg())-size, 16u);
+  second.close();
+
+    //id del primo lato spostato di 1e8 dalla sua posizione (il passo viene ricodificato con la nuova lunghezza)
+  TriangularMesh B("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+  B.ExportDelta(path);
+  ifstream file(path, ios::binary);
+  string delta((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+  file.close();
+  ArchiveReader length(delta.data()+5, delta.data()+delta.size());
+  length.Varint();
+  string body = delta.substr(length.Position()-delta.data());
+  ArchiveReader rows(body.data(), body.data()+body.size());
+  for(unsigned int k=0; k<3; k++) rows.Varint();
+  uint64_t nP = rows.Varint(), previous_x = 0, previous_y = 0;
+  for(uint64_t i=0; i<nP; i++){rows.Varint(); rows.Signed(); rows.Varint(); rows.Double(previous_x, true); rows.Double(previous_y, true);}
+  rows.Varint(); rows.Varint();
+  size_t id_begin = rows.Position()-body.data();
+  ASSERT_EQ(rows.Signed(), 0);
+  ArchiveWriter id, step;
+  id.Signed(100000000);
+  body = body.substr(0, id_begin)+string(id.data.begin(), id.data.end())+body.substr(rows.Position()-body.data());
+  step.data = {'R','D','L','T',1};
+  step.Varint(body.size());
+  ofstream corrupt(path, ios::binary);
+  corrupt<<string(step.data.begin(), step.data.end())<<body;
+  corrupt.close();
+  EXPECT_ANY_THROW(TriangularMesh("delta_test.rdlt",1));
+  remove(path.c_str());
+}
 //TEST(TestMesh, TestAdjacenceMatrix)
 //{
 //  M.AdjacenceMatrix();
 //  EXPECT_EQ(T.PointsToEdge(Point(1,1,1),Point(5,5,5)).id, UINT_MAX);
 //}
 
-
+TEST(TestMesh, TestRefinementTree)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+  unsigned int n0 = M.NumberTriangles();
+  vector<double> area(n0);
+  for(unsigned int i=0; i<n0; i++) area[i] = M.FindTriangle(i).area;
+  M.RecordTree();
+  M.Refining(0.5,"advanced","uniform");
+  RefinementTree &tree = M.Tree();
+  vector<double> leaves_area(n0, 0);
+  unsigned int n_leaves = 0;
+  for(unsigned int node=0; node<tree.Size(); node++){
+    if(!tree.IsLeaf(node)) continue;
+    n_leaves++;
+    EXPECT_EQ(tree.leaf[tree.triangle[node]], node);
+    EXPECT_EQ(tree.Ancestor(node,0), tree.Root(node));
+    leaves_area[tree.Root(node)] += M.FindTriangle(tree.triangle[node]).area;
+  }
+  EXPECT_EQ(n_leaves, M.NumberTriangles());
+  for(unsigned int i=0; i<n0; i++) EXPECT_NEAR(leaves_area[i], area[i], 1e-12);
+  unsigned int n_nodes = 0;
+  for(unsigned int l=0; l<tree.Levels(); l++)
+    for(unsigned int node : tree.NodesAtLevel(l)){
+      EXPECT_EQ(tree.level[node], l);
+      if(l>0){EXPECT_EQ(tree.Parent(tree.Sibling(node)), tree.Parent(node));}
+      n_nodes++;
+    }
+  EXPECT_EQ(n_nodes, tree.Size());
+}
+TEST(TestMesh, TestCoarsening)
+{
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    unsigned int nP = M.NumberPoints(), nE = M.NumberEdges(), nT = M.NumberTriangles();
+    double area = M.AvgArea()*nT;
+    M.RecordTree();
+    M.Refining(0.6,level,"uniform");
+    // solo i triangoli piccoli
+    double avg = M.AvgArea();
+    M.Coarsening([avg](const Triangle &T){return T.area<avg;});
+    EXPECT_TRUE(M.Conforming());
+    while(M.Coarsening([](const Triangle &){return true;})>0)
+      EXPECT_TRUE(M.Conforming());
+    EXPECT_EQ(M.NumberPoints(), nP);
+    EXPECT_EQ(M.NumberEdges(), nE);
+    EXPECT_EQ(M.NumberTriangles(), nT);
+    EXPECT_NEAR(M.AvgArea()*M.NumberTriangles(), area, 1e-12);
+      //nuovo ciclo di raffinamento sulla mesh riportata a quella di partenza
+    M.Refining(0.3,level,"non-uniform");
+    EXPECT_TRUE(M.Conforming());
+    M.Coarsening([](const Triangle &){return true;});
+    EXPECT_TRUE(M.Conforming());
+  }
+}
+TEST(TestMesh, TestCoarseningIncremental)
+{
+    //candidati e lati di bordo aggiornati localmente uguali a quelli ricalcolati da zero
+  auto check = [](TriangularMesh &M){
+    RefinementTree &tree = M.Tree();
+    vector<unsigned int> mergeable(tree.mergeable), expected;
+    for(unsigned int m=0; m<M.NumberPoints(); m++)
+      if(tree.Mergeable(m)) expected.push_back(m);
+    sort(mergeable.begin(), mergeable.end());
+    EXPECT_EQ(mergeable, expected);
+    for(unsigned int marker=1; marker<10; marker++){
+      vector<unsigned int> marked = M.MarkedEdges(marker), edges;
+      for(unsigned int i=0; i<M.NumberEdges(); i++)
+        if(M.EdgeMarker(i)==marker) edges.push_back(i);
+      sort(marked.begin(), marked.end());
+      EXPECT_EQ(marked, edges);
+    }
+  };
+  vector<double> x, y;
+  for(unsigned int i=0; i<500; i++){
+    x.push_back(0.5+0.3*cos(0.7*i)*(i%50)/50.0);
+    y.push_back(0.5+0.3*sin(0.7*i)*(i%50)/50.0);
+  }
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+    M.RecordTree();
+    Region box = Region::Box(0.1,0.1,0.3,0.3);
+    EXPECT_GT(M.RefiningRegion(box, 1e-3, level), 0u);
+    check(M);
+    double avg = M.AvgArea();
+    EXPECT_GT(M.Coarsening([avg](const Triangle &T){return T.area<avg;}), 0u);
+    EXPECT_TRUE(M.Conforming());
+    check(M);
+      //la griglia già costruita deve seguire unioni e spostamenti
+    Region circle = Region::Circle(0.7,0.6,0.1);
+    EXPECT_GT(M.RefiningRegion(circle, 1e-3, level), 0u);
+    EXPECT_TRUE(M.Conforming());
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){
+      Triangle T = M.FindTriangle(i);
+      if(circle.Intersects(T.points)){EXPECT_LE(T.area, 1e-3);}
+    }
+    check(M);
+      //i campioni dei triangoli uniti passano al triangolo intero
+    EXPECT_GT(M.RefiningDensity(x, y, 10, level), 0u);
+    while(M.Coarsening([](const Triangle &){return true;})>0){
+      EXPECT_TRUE(M.Conforming());
+      check(M);
+      vector<unsigned int> density = M.Density();
+      unsigned int total = 0;
+      for(unsigned int d : density) total += d;
+      EXPECT_EQ(total, x.size());
+    }
+  }
+}
+TEST(TestMesh, TestJournal)
+{
+  for(string level : {"base","advanced","newest"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2), R("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",2);
+    M.RecordJournal();
+    M.Refining(0.5,level,"uniform");
+    M.ExportJournal("journal_test.bin");
+    TriangularMesh C = R.Clone();
+    R.ReplayJournal("journal_test.bin");
+    ifstream file("journal_test.bin", ios::binary);
+    string journal((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
+      //giornali danneggiati: ordine dei byte, conteggio dei record, id fuori dalla mesh
+    auto corrupt = [&](size_t offset, uint32_t value){
+      string content = journal;
+      memcpy(&content[offset], &value, sizeof(value));
+      ofstream out("journal_test.bin", ios::binary);
+      out<<content;
+      out.close();
+      TriangularMesh D = C.Clone();
+      EXPECT_ANY_THROW(D.ReplayJournal("journal_test.bin"));
+    };
+    size_t records = 6*sizeof(uint32_t)+sizeof(double)+2*sizeof(uint32_t)+level.size()+strlen("uniform");
+    corrupt(2*sizeof(uint32_t), 0x04030201);
+    corrupt(records, UINT32_MAX);
+    corrupt(records+sizeof(uint64_t)+offsetof(JournalRecord, triangle), C.NumberTriangles());
+    corrupt(records+sizeof(uint64_t)+offsetof(JournalRecord, a), UINT32_MAX);
+    remove("journal_test.bin");
+    ASSERT_EQ(R.NumberTriangles(), M.NumberTriangles());
+    ASSERT_EQ(R.NumberEdges(), M.NumberEdges());
+    ASSERT_EQ(R.NumberPoints(), M.NumberPoints());
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){
+      ostringstream t1, t2;
+      t1<<M.FindTriangle(i); t2<<R.FindTriangle(i);
+      EXPECT_EQ(t1.str(), t2.str());
+    }
+    for(unsigned int i=0; i<M.NumberEdges(); i++){
+      ostringstream e1, e2;
+      e1<<M.FindEdge(i); e2<<R.FindEdge(i);
+      EXPECT_EQ(e1.str(), e2.str());
+    }
+    EXPECT_TRUE(R.Conforming());
+  }
+    //Test1 ha lati di uguale lunghezza (vedi TestNewestTies): il replay deve ripartire dalle etichette di LabelNewest,
+    //anche per i triangoli non divisi che ResumeRefining dividerà dopo
+  for(string unif : {"non-uniform","uniform"}){
+    TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1), R("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+    M.RecordJournal();
+    M.Refining(0.3,"newest",unif);
+    M.ExportJournal("journal_test.bin");
+    R.ReplayJournal("journal_test.bin");
+    remove("journal_test.bin");
+    M.ResumeRefining(0.6);
+    R.ResumeRefining(0.6);
+    ASSERT_EQ(R.NumberTriangles(), M.NumberTriangles());
+    for(unsigned int i=0; i<M.NumberTriangles(); i++){
+      ostringstream t1, t2;
+      t1<<M.FindTriangle(i); t2<<R.FindTriangle(i);
+      EXPECT_EQ(t1.str(), t2.str());
+    }
+    EXPECT_TRUE(R.Conforming());
+  }
+}
+    //TEST VIRTUAL MESH
+TEST(TestVirtualMesh, TestArea)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+  EXPECT_ANY_THROW(VirtualMesh(M,3));  //con k dispari la mesh non è conforme
+  VirtualMesh V(M,4);
+  EXPECT_EQ(V.NumberTriangles(), M.NumberTriangles()*16);
+  double area=0;
+  unsigned int n=0;
+  for(const VirtualMesh::Cell &c : V){
+    const array<Point,3> &p = c.points;
+    double a = 0.5*((p[1].x-p[0].x)*(p[2].y-p[0].y)-(p[2].x-p[0].x)*(p[1].y-p[0].y));
+    EXPECT_GT(a, 0);  //orientamento antiorario conservato
+    area += a;
+    n++;
+  }
+  EXPECT_EQ(n, V.NumberTriangles());
+  EXPECT_NEAR(area, M.AvgArea()*M.NumberTriangles(), 1e-12);
+}
+TEST(TestVirtualMesh, TestGetTriangle)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",0);
+  VirtualMesh V(M,4);
+  for(const VirtualMesh::Cell &c : V)
+    EXPECT_EQ(V.GetTriangle(c.id).points, c.points);
+  unsigned int n=0;
+  for(const Edge E : V.Edges()) EXPECT_EQ(E.id, n++);
+  EXPECT_EQ(n, V.NumberEdges());
+    //i vertici e i lati condivisi hanno lo stesso id in tutti i triangoli
+  vector<unsigned int> uses(V.NumberEdges(), 0);
+  for(const VirtualMesh::Cell &c : V)
+    for(unsigned int i=0; i<3; i++){
+      Point p = V.GetPoint(c.points[i].id);
+      EXPECT_EQ(p.x, c.points[i].x);
+      EXPECT_EQ(p.y, c.points[i].y);
+      Edge E = V.GetEdge(c.edges[i]);
+      EXPECT_EQ(E.id, c.edges[i]);
+      EXPECT_TRUE(E.Includes(c.points[i]) && E.Includes(c.points[(i+1)%3]));
+      uses[c.edges[i]]++;
+    }
+  for(unsigned int u : uses){EXPECT_TRUE(u==1 || u==2);}
+}
+TEST(TestVirtualMesh, TestExport)
+{
+  TriangularMesh M("Cell0Ds.csv","Cell1Ds.csv","Cell2Ds.csv",1);
+  string path = "./../Project/Dataset/Test1/";
+  for(unsigned int k : {0u, 2u, 6u}){
+    VirtualMesh V(M,k);
+    V.ExportCell0D(path+"virtual0D.csv", 3);
+    V.ExportCell1D(path+"virtual1D.csv", 3);
+    V.ExportCell2D(path+"virtual2D.csv", 3);
+    TriangularMesh R("virtual0D.csv","virtual1D.csv","virtual2D.csv",1);
+    EXPECT_EQ(R.NumberPoints(), V.NumberPoints());
+    EXPECT_EQ(R.NumberEdges(), V.NumberEdges());
+    EXPECT_EQ(R.NumberTriangles(), V.NumberTriangles());
+    EXPECT_TRUE(R.Conforming());
+    EXPECT_NEAR(R.AvgArea()*R.NumberTriangles(), M.AvgArea()*M.NumberTriangles(), 1e-9);
+      //ogni lato di partenza è diviso in 2^(k/2) segmenti con il suo marker
+    for(unsigned int marker=1; marker<10; marker++){EXPECT_EQ(R.MarkedEdges(marker).size(), M.MarkedEdges(marker).size()<<(k/2));}
+    for(unsigned int i=0; i<R.NumberPoints(); i++){EXPECT_EQ(R.PointMarker(i), V.PointMarker(i));}
+  }
+  remove((path+"virtual0D.csv").c_str()); remove((path+"virtual1D.csv").c_str()); remove((path+"virtual2D.csv").c_str());
+}
 
 //TEST(TestRaffinamento, Test)
 //{